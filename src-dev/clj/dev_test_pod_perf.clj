@@ -61,3 +61,37 @@
   ;; [socket]: 2547
 
   #_())
+
+;; p99 latency of concurrent callers, compare the pod's thread placement by
+;; starting bb with e.g. `POD_AFFINITY='reader=0;workers=node1' bb ...` (the
+;; pod inherits the environment; see src/cpp/pod_affinity.h for the syntax).
+(defn latency-percentiles [add-fn n callers]
+  (let [lats (->> (range callers)
+                  (mapv (fn [_]
+                          (future
+                            (vec (for [_ (range (quot n callers))]
+                                   (let [t (System/nanoTime)]
+                                     (add-fn 42 24)
+                                     (- (System/nanoTime) t)))))))
+                  (mapcat deref)
+                  sort
+                  vec)
+        at (fn [p] (/ (nth lats (min (dec (count lats)) (int (* p (count lats))))) 1e6))]
+    {:p50 (at 0.5) :p99 (at 0.99) :max (at 1.0)}))
+
+(comment
+  (reload-pod "perf-affinity")
+  (latency-percentiles @(resolve 'test-pod/add-async) 20000 8)
+  (pods/unload-pod {:pod/id "perf-affinity"})
+  #_())
+
+;; bulk calls in one round trip, with the builtin invoke-many.
+(comment
+  (reload-pod "perf-many")
+  (require '[lotuc.babashka.pods])
+  (let [invoke-many @(resolve 'lotuc.babashka.pods/invoke-many)
+        t0 (System/currentTimeMillis)
+        rs (invoke-many (vec (repeat 10000 {:var "perf-many/add-sync" :args [42 24]})))]
+    (println "[invoke-many]:" (- (System/currentTimeMillis) t0) (count rs)))
+  (pods/unload-pod {:pod/id "perf-many"})
+  #_())
@@ -0,0 +1,127 @@
+// Where payload compression pays off (see `pod_compress.h`).
+//
+//   bench_compress [MB/s ...]
+//
+// For JSON payloads of growing sizes, measures each compiled in codec (pack &
+// unpack time, ratio), and the time to move the payload over links of the
+// given bandwidths (100, 1000 & 10000 MB/s by default): raw, vs packed +
+// transferred + unpacked. The crossover is the smallest size from which the
+// codec wins on a link, the pod's `compression_threshold` should sit near it.
+
+#include "pod_compress.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace compress = lotuc::pod::compress;
+
+namespace
+{
+  /** A JSON list of records, repetitive like real results. */
+  std::string payload(std::size_t size)
+  {
+    std::string s{ "[" };
+    for(std::size_t i = 0; s.size() < size; i++)
+    {
+      s += i == 0 ? "" : ",";
+      s += "{\"id\":" + std::to_string(i) + ",\"name\":\"item-" + std::to_string(i * 7919 % 1000)
+           + "\",\"score\":" + std::to_string(i * 31 % 977) + ".5,\"tags\":[\"a\",\"b\"]}";
+    }
+    s.resize(size - 1);
+    s += "]";
+    return s;
+  }
+
+  /** Seconds per call of `f`, repeated for at least 50 ms. */
+  template <typename F>
+  double per_call(F &&f)
+  {
+    using clock = std::chrono::steady_clock;
+    std::size_t n{ 0 };
+    auto start = clock::now();
+    std::chrono::duration<double> elapsed{};
+    do
+    {
+      f();
+      n++;
+      elapsed = clock::now() - start;
+    } while(elapsed.count() < 0.05);
+    return elapsed.count() / static_cast<double>(n);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<double> links{};
+  for(int i = 1; i < argc; i++)
+  {
+    links.push_back(std::atof(argv[i]));
+  }
+  if(links.empty())
+  {
+    links = { 100, 1000, 10000 };
+  }
+  if(compress::codecs().empty())
+  {
+    std::fprintf(stderr, "no codec compiled in (LOTUC_POD_WITH_LZ4 / LOTUC_POD_WITH_ZSTD)\n");
+    return 1;
+  }
+
+  for(auto codec : compress::codecs())
+  {
+    std::printf("%.*s\n", static_cast<int>(codec->name().size()), codec->name().data());
+    std::printf("%10s %7s %10s %11s", "bytes", "ratio", "pack MB/s", "unpack MB/s");
+    for(auto mbps : links)
+    {
+      std::printf(" %8.0f MB/s", mbps);
+    }
+    std::printf("\n");
+
+    std::vector<std::size_t> crossover(links.size(), 0);
+    for(std::size_t size = 64; size <= (std::size_t{ 1 } << 24); size *= 2)
+    {
+      auto raw = payload(size);
+      auto packed = codec->compress(raw);
+      auto pack = per_call([&] { codec->compress(raw); });
+      auto unpack = per_call([&] { codec->decompress(packed, raw.size()); });
+      auto mb = static_cast<double>(size) / 1e6;
+      std::printf("%10zu %7.2f %10.0f %11.0f",
+                  size,
+                  static_cast<double>(size) / static_cast<double>(packed.size()),
+                  mb / pack,
+                  mb / unpack);
+      for(std::size_t l = 0; l < links.size(); l++)
+      {
+        auto plain = mb / links[l];
+        auto packed_s = pack + static_cast<double>(packed.size()) / 1e6 / links[l] + unpack;
+        // the gain (or loss, negative) in transfer time.
+        std::printf(" %+12.0f%%", (plain / packed_s - 1) * 100);
+        if(packed_s < plain && crossover[l] == 0)
+        {
+          crossover[l] = size;
+        }
+        else if(packed_s >= plain)
+        {
+          crossover[l] = 0;
+        }
+      }
+      std::printf("\n");
+    }
+    for(std::size_t l = 0; l < links.size(); l++)
+    {
+      if(crossover[l] == 0)
+      {
+        std::printf("  %.0f MB/s: never pays off\n", links[l]);
+      }
+      else
+      {
+        std::printf("  %.0f MB/s: pays off from %zu bytes\n", links[l], crossover[l]);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,331 @@
+// Replays a recorded pod traffic (see `pod_record.h`) against a pod & reports
+// the per var latency, recorded vs replayed.
+//
+//   pod_replay <recording> [--speed <x>] -- <pod command> [args...]
+//
+// `--speed 1` (default) sends the requests at the recorded pace, `2` twice as
+// fast, `0` as fast as possible.
+
+#include "pod_record.h"
+
+#include <nlohmann/json.hpp>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+namespace bc = bencode;
+namespace recording = lotuc::pod::recording;
+using json = nlohmann::json;
+
+namespace
+{
+  struct Call
+  {
+    std::string id;
+    std::string var;
+  };
+
+  /** The string at `key`, `nullptr` if absent or not a string. */
+  bc::string const *string_at(bc::dict const &d, std::string const &key)
+  {
+    auto it = d.find(key);
+    return it != d.cend() ? std::get_if<bc::string>(&it->second) : nullptr;
+  }
+
+  /** The invoke (or JSON-RPC call) of a client frame, malformed ones are
+   * skipped.
+   */
+  std::optional<Call> request_of(char format, std::string const &bytes)
+  {
+    if(format == 'j')
+    {
+      auto v = json::parse(bytes, nullptr, false);
+      if(!v.is_object() || !v.contains("method") || !v["method"].is_string() || !v.contains("id"))
+      {
+        return std::nullopt;
+      }
+      return Call{ v["id"].dump(), v["method"].get<std::string>() };
+    }
+    auto v = bc::decode(bytes.begin(), bytes.end());
+    auto d = std::get_if<bc::dict>(&v);
+    if(d == nullptr)
+    {
+      return std::nullopt;
+    }
+    auto op = string_at(*d, "op");
+    auto id = string_at(*d, "id");
+    auto var = string_at(*d, "var");
+    if(op == nullptr || *op != "invoke" || id == nullptr || var == nullptr)
+    {
+      return std::nullopt;
+    }
+    return Call{ *id, *var };
+  }
+
+  /** The id of the call a pod frame finishes, malformed ones are skipped. */
+  std::optional<std::string> done_of(char format, std::string const &bytes)
+  {
+    if(format == 'j')
+    {
+      auto v = json::parse(bytes, nullptr, false);
+      if(!v.is_object() || !v.contains("id") || (!v.contains("result") && !v.contains("error")))
+      {
+        return std::nullopt;
+      }
+      return v["id"].dump();
+    }
+    auto v = bc::decode(bytes.begin(), bytes.end());
+    auto d = std::get_if<bc::dict>(&v);
+    if(d == nullptr || !d->contains("status"))
+    {
+      return std::nullopt;
+    }
+    auto id = string_at(*d, "id");
+    auto status = std::get_if<bc::list>(&d->at("status"));
+    if(id == nullptr || status == nullptr)
+    {
+      return std::nullopt;
+    }
+    for(auto &s : *status)
+    {
+      if(auto st = std::get_if<bc::string>(&s); st != nullptr && *st == "done")
+      {
+        return *id;
+      }
+    }
+    return std::nullopt;
+  }
+
+  class FdBuf : public std::streambuf
+  {
+  public:
+    explicit FdBuf(int fd)
+      : _fd{ fd }
+    {
+    }
+
+  protected:
+    int_type underflow() override
+    {
+      auto n = ::read(_fd, _buf, sizeof(_buf));
+      if(n <= 0)
+      {
+        return traits_type::eof();
+      }
+      setg(_buf, _buf, _buf + n);
+      return traits_type::to_int_type(*gptr());
+    }
+
+  private:
+    int _fd;
+    char _buf[1 << 16];
+  };
+
+  double percentile(std::vector<double> v, double p)
+  {
+    if(v.empty())
+    {
+      return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, static_cast<std::size_t>(p * v.size()))];
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::string path{};
+  double speed{ 1 };
+  int cmd{ -1 };
+  for(int i = 1; i < argc; i++)
+  {
+    std::string a{ argv[i] };
+    if(a == "--")
+    {
+      cmd = i + 1;
+      break;
+    }
+    else if(a == "--speed" && i + 1 < argc)
+    {
+      speed = std::stod(argv[++i]);
+    }
+    else
+    {
+      path = a;
+    }
+  }
+  if(path.empty() || cmd < 0 || cmd >= argc)
+  {
+    std::cerr << "usage: pod_replay <recording> [--speed <x>] -- <pod command> [args...]\n";
+    return 2;
+  }
+
+  // recorded latencies & the client frames to send.
+  std::optional<recording::Reader> log{};
+  try
+  {
+    log.emplace(path);
+  }
+  catch(std::exception const &e)
+  {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+  auto format = log->format;
+  std::vector<recording::Frame> requests;
+  std::map<std::string, std::pair<std::string, std::uint64_t>> recorded_calls;
+  std::map<std::string, std::vector<double>> recorded, replayed;
+  while(auto f = log->next())
+  {
+    if(f->dir == '<')
+    {
+      if(auto c = request_of(format, f->bytes))
+      {
+        recorded_calls[c->id] = { c->var, f->ts_us };
+      }
+      requests.push_back(std::move(f.value()));
+    }
+    else if(auto id = done_of(format, f->bytes))
+    {
+      if(auto it = recorded_calls.find(*id); it != recorded_calls.end())
+      {
+        recorded[it->second.first].push_back((f->ts_us - it->second.second) / 1000.0);
+        recorded_calls.erase(it);
+      }
+    }
+  }
+
+  int in[2], out[2];
+  if(::pipe(in) != 0 || ::pipe(out) != 0)
+  {
+    std::perror("pipe");
+    return 1;
+  }
+  auto pid = ::fork();
+  if(pid == 0)
+  {
+    ::dup2(in[0], 0);
+    ::dup2(out[1], 1);
+    ::close(in[1]);
+    ::close(out[0]);
+    ::execvp(argv[cmd], argv + cmd);
+    std::perror("execvp");
+    std::_Exit(127);
+  }
+  ::close(in[0]);
+  ::close(out[1]);
+  ::signal(SIGPIPE, SIG_IGN);
+
+  using clock = std::chrono::steady_clock;
+  std::mutex lock;
+  std::condition_variable answered;
+  std::map<std::string, std::pair<std::string, clock::time_point>> calls;
+
+  std::thread reader([&]() {
+    FdBuf buf{ out[0] };
+    std::istream is{ &buf };
+    while(true)
+    {
+      std::string bytes;
+      try
+      {
+        if(format == 'j')
+        {
+          if(!std::getline(is, bytes))
+          {
+            break;
+          }
+        }
+        else
+        {
+          bytes = bc::encode(bc::decode_some(is, bc::no_check_eof));
+        }
+        auto id = done_of(format, bytes);
+        if(!id)
+        {
+          continue;
+        }
+        std::lock_guard<std::mutex> l(lock);
+        if(auto it = calls.find(*id); it != calls.end())
+        {
+          auto ms = std::chrono::duration<double, std::milli>(clock::now() - it->second.second);
+          replayed[it->second.first].push_back(ms.count());
+          calls.erase(it);
+          answered.notify_all();
+        }
+      }
+      catch(std::exception const &)
+      {
+        break;
+      }
+    }
+    std::lock_guard<std::mutex> l(lock);
+    calls.clear();
+    answered.notify_all();
+  });
+
+  auto start = clock::now();
+  auto first_us = requests.empty() ? 0 : requests.front().ts_us;
+  for(auto &f : requests)
+  {
+    if(speed > 0)
+    {
+      auto offset = static_cast<long long>((f.ts_us - first_us) / speed);
+      std::this_thread::sleep_until(start + std::chrono::microseconds{ offset });
+    }
+    if(auto c = request_of(format, f.bytes))
+    {
+      std::lock_guard<std::mutex> l(lock);
+      calls[c->id] = { c->var, clock::now() };
+    }
+    if(format == 'j')
+    {
+      f.bytes.push_back('\n');
+    }
+    for(std::size_t n = 0; n < f.bytes.size();)
+    {
+      auto w = ::write(in[1], f.bytes.data() + n, f.bytes.size() - n);
+      if(w <= 0)
+      {
+        break;
+      }
+      n += static_cast<std::size_t>(w);
+    }
+  }
+  {
+    std::unique_lock<std::mutex> l(lock);
+    answered.wait_for(l, std::chrono::seconds{ 30 }, [&]() { return calls.empty(); });
+  }
+  ::close(in[1]);
+  int status{};
+  ::kill(pid, SIGTERM);
+  ::waitpid(pid, &status, 0);
+  reader.join();
+
+  std::cout << std::left << std::setw(40) << "var" << std::right << std::setw(8) << "n"
+            << std::setw(12) << "rec p50" << std::setw(12) << "rec p99" << std::setw(12)
+            << "new p50" << std::setw(12) << "new p99" << std::setw(12) << "p99 delta" << "\n";
+  std::cout << std::fixed << std::setprecision(3);
+  for(auto &[var, lats] : replayed)
+  {
+    auto &rec = recorded[var];
+    auto rec_p99 = percentile(rec, 0.99);
+    auto new_p99 = percentile(lats, 0.99);
+    std::cout << std::left << std::setw(40) << var << std::right << std::setw(8) << lats.size()
+              << std::setw(12) << percentile(rec, 0.5) << std::setw(12) << rec_p99 << std::setw(12)
+              << percentile(lats, 0.5) << std::setw(12) << new_p99 << std::setw(12)
+              << new_p99 - rec_p99 << "\n";
+  }
+  return 0;
+}
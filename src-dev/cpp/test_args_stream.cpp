@@ -0,0 +1,182 @@
+// Streamed invoke args, see `ArgsStream` in `pod.h`: the client stays within
+// the credit window the reader grants back, a chunk overrunning it fails the
+// stream, & so does a client stalling for the timeout.
+
+#include "pod.h"
+#include "test_support.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace
+{
+  namespace pod = lotuc::pod;
+  using namespace std::chrono_literals;
+  using clock = std::chrono::steady_clock;
+
+  /** The client's side of the window: the bytes it may still send. */
+  class Credits
+  {
+  public:
+    explicit Credits(std::size_t window)
+      : _available{ window }
+    {
+    }
+
+    void grant(std::size_t n)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      _available += n;
+      _granted += n;
+      _changed.notify_all();
+    }
+
+    void take(std::size_t n)
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      _changed.wait(lock, [&]() { return _available >= n; });
+      _available -= n;
+    }
+
+    std::size_t granted()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      return _granted;
+    }
+
+  private:
+    std::mutex _lock;
+    std::condition_variable _changed;
+    std::size_t _available;
+    std::size_t _granted{ 0 };
+  };
+
+  long long current(pod::MemoryBudget &memory)
+  {
+    return memory.usage()["current"];
+  }
+
+  /** Reads the stream to its end, the error if it fails. */
+  std::string read_all(pod::ArgsStream &input, std::string &error)
+  {
+    std::string all;
+    try
+    {
+      while(auto chunk = input.read())
+      {
+        all += *chunk;
+      }
+    }
+    catch(std::exception const &e)
+    {
+      error = e.what();
+    }
+    return all;
+  }
+
+  void client_within_the_window()
+  {
+    std::size_t const window = 16;
+    pod::TimerWheel timers;
+    pod::MemoryBudget memory;
+    Credits credits{ window };
+    auto closed = 0;
+    pod::ArgsStream input{
+      window, 1000ms, timers, memory, [&](std::size_t n) { credits.grant(n); }, [&]() { closed++; }
+    };
+    std::string sent;
+    std::thread client([&]() {
+      for(int i = 0; i < 1000; i++)
+      {
+        auto chunk = std::to_string(i);
+        credits.take(chunk.size());
+        CHECK(input.push(chunk));
+        sent += chunk;
+      }
+      input.end();
+    });
+    std::string error;
+    auto read = read_all(input, error);
+    client.join();
+    CHECK(error.empty());
+    CHECK(read == sent);
+    CHECK(input.bytes_read() == sent.size());
+    // granted by halves of the window, the tail once ended is not.
+    CHECK(credits.granted() > 0);
+    CHECK(credits.granted() <= sent.size());
+    CHECK(current(memory) == 0);
+    input.close();
+    input.close();
+    CHECK(closed == 1);
+  }
+
+  void overrunning_the_window_fails()
+  {
+    pod::TimerWheel timers;
+    pod::MemoryBudget memory;
+    pod::ArgsStream input{ 8, 1000ms, timers, memory, [](std::size_t) {}, []() {} };
+    CHECK(input.push("abcd"));
+    CHECK(input.push("efgh"));
+    CHECK(current(memory) == 8);
+    CHECK(!input.push("i"));
+    // the buffered chunks are dropped with the stream.
+    CHECK(current(memory) == 0);
+    CHECK(!input.push("j"));
+    std::string error;
+    read_all(input, error);
+    CHECK(error.find("window exceeded") != std::string::npos);
+  }
+
+  void stalled_client_times_out()
+  {
+    pod::TimerWheel timers;
+    pod::MemoryBudget memory;
+    pod::ArgsStream input{ 64, 100ms, timers, memory, [](std::size_t) {}, []() {} };
+    CHECK(input.push("ab"));
+    auto start = clock::now();
+    std::string error;
+    auto read = read_all(input, error);
+    auto waited = clock::now() - start;
+    CHECK(read == "ab");
+    CHECK(error.find("timed out") != std::string::npos);
+    CHECK(waited >= 100ms);
+    CHECK(waited < 1000ms);
+    // the stall timer is gone with the read.
+    CHECK(timers.size() == 0);
+  }
+
+  void paced_client_does_not_time_out()
+  {
+    pod::TimerWheel timers;
+    pod::MemoryBudget memory;
+    pod::ArgsStream input{ 64, 200ms, timers, memory, [](std::size_t) {}, []() {} };
+    std::thread client([&]() {
+      // each chunk is within the timeout of the previous one.
+      for(int i = 0; i < 5; i++)
+      {
+        std::this_thread::sleep_for(50ms);
+        input.push("x");
+      }
+      input.end();
+    });
+    std::string error;
+    auto read = read_all(input, error);
+    client.join();
+    CHECK(error.empty());
+    CHECK(read == "xxxxx");
+  }
+}
+
+int main()
+{
+  client_within_the_window();
+  overrunning_the_window_fails();
+  stalled_client_times_out();
+  paced_client_does_not_time_out();
+  return test_support::result();
+}
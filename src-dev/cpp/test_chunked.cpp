@@ -0,0 +1,93 @@
+// Chunked results, see `write_value`: with the `chunk-size` invoke option a
+// large value is sent as `value-chunk` responses of about that size, their
+// concatenation is the same encoded value as the unchunked response.
+
+#include "test_client.h"
+#include "test_support.h"
+
+#include <chrono>
+#include <optional>
+#include <string>
+
+namespace
+{
+  using namespace std::chrono_literals;
+  using test_support::MemoryTransport;
+  using test_support::TestPod;
+
+  json expected_range(int n)
+  {
+    auto v = json::array();
+    for(int i = 0; i < n; i++)
+    {
+      v.push_back(i);
+    }
+    return v;
+  }
+
+  void chunks_reassemble_to_the_value()
+  {
+    TestPod p;
+    int const n = 20000;
+    std::size_t const chunk_size = 1000;
+    p.invoke("c",
+             "test-pod/large_range",
+             json::array({ n }),
+             { { "chunk-size", static_cast<bencode::integer>(chunk_size) } });
+    auto responses = p.transport.wait_done("c", 5s);
+    CHECK(responses.size() > 2);
+
+    std::string reassembled;
+    std::size_t chunks{ 0 };
+    for(std::size_t i = 0; i < responses.size(); i++)
+    {
+      auto &r = responses[i];
+      auto last = i + 1 == responses.size();
+      // the value only comes in chunks, the last response ends it.
+      CHECK(!r.contains("value"));
+      CHECK(MemoryTransport::is_done(r) == last);
+      if(auto chunk = r.find("value-chunk"); chunk != r.cend())
+      {
+        auto &s = std::get<bencode::string>(chunk->second);
+        // about `chunk-size`: a chunk is sent once the written pieces reach it.
+        CHECK(s.size() >= chunk_size || i + 2 >= responses.size());
+        CHECK(s.size() < 2 * chunk_size);
+        reassembled += s;
+        chunks++;
+      }
+    }
+    CHECK(chunks == responses.size() - 1);
+    CHECK(json::parse(reassembled) == expected_range(n));
+
+    // the same value, unchunked.
+    p.invoke("v", "test-pod/large_range", json::array({ n }));
+    auto whole = p.transport.wait_done("v", 5s);
+    CHECK(whole.size() == 1);
+    CHECK(!whole.empty() && std::get<bencode::string>(whole[0].at("value")) == reassembled);
+
+    // the written pieces are accounted until sent, the rest until the
+    // invokes are finished.
+    CHECK(p.shutdown(5s) == std::optional<bool>{ true });
+    CHECK(p.ctx->memory.usage()["current"] == 0);
+  }
+
+  void small_values_are_one_chunk()
+  {
+    TestPod p;
+    p.invoke("s", "test-pod/large_range", json::array({ 3 }), { { "chunk-size", 1000 } });
+    auto responses = p.transport.wait_done("s", 5s);
+    CHECK(responses.size() == 2);
+    if(responses.size() == 2)
+    {
+      CHECK(std::get<bencode::string>(responses[0].at("value-chunk")) == "[0,1,2]");
+      CHECK(MemoryTransport::is_done(responses[1]));
+    }
+  }
+}
+
+int main()
+{
+  chunks_reassemble_to_the_value();
+  small_values_are_one_chunk();
+  return test_support::result();
+}
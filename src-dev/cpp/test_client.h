@@ -0,0 +1,269 @@
+#ifndef TEST_CLIENT_H_
+#define TEST_CLIENT_H_
+
+#include "pod.h"
+#include "pod_json_encoder.h"
+#include "test_ns.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The test pod (`test_ns.h`) over an in-memory transport, for the test
+// programs playing its client: requests are queued for the pod's read loop,
+// the responses are collected as the pod writes them.
+
+namespace test_support
+{
+  namespace bc = bencode;
+
+  class MemoryTransport : public lotuc::pod::BencodeTransport
+  {
+  public:
+    /** Queues a request for the pod. */
+    void send(bc::dict request)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      _requests.push_back(std::move(request));
+      _changed.notify_all();
+    }
+
+    /** The client is gone, the pod's next read fails. */
+    void hang_up()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      _hung_up = true;
+      _changed.notify_all();
+    }
+
+    bc::data read() override
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      _changed.wait(lock, [this]() { return !_requests.empty() || _hung_up; });
+      if(_requests.empty())
+      {
+        throw std::runtime_error{ "eof" };
+      }
+      auto d = std::move(_requests.front());
+      _requests.pop_front();
+      return d;
+    }
+
+    void write(bc::data const &d) override
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      if(auto m = std::get_if<bc::dict>(&d); m)
+      {
+        _responses.push_back(*m);
+      }
+      _changed.notify_all();
+    }
+
+    /** The responses to `id` so far. */
+    std::vector<bc::dict> responses(std::string const &id)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      return responses_locked(id);
+    }
+
+    /** The first response matching `pred`, waited for up to `timeout`. */
+    std::optional<bc::dict> wait_for(std::function<bool(bc::dict const &)> const &pred,
+                                     std::chrono::milliseconds timeout)
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      std::optional<bc::dict> found;
+      _changed.wait_for(lock, timeout, [&]() {
+        for(auto &r : _responses)
+        {
+          if(pred(r))
+          {
+            found = r;
+            return true;
+          }
+        }
+        return false;
+      });
+      return found;
+    }
+
+    /** The responses to `id` once it's done, empty if it isn't in time. */
+    std::vector<bc::dict> wait_done(std::string const &id, std::chrono::milliseconds timeout)
+    {
+      if(!wait_for([&](auto &r) { return id_of(r) == id && is_done(r); }, timeout))
+      {
+        return {};
+      }
+      return responses(id);
+    }
+
+    /** The responses to `id` once there are `n`, the ones so far if not in
+     * time. The id-less responses (`describe`'s) are the ones to "".
+     */
+    std::vector<bc::dict> wait_count(std::string const &id,
+                                     std::size_t n,
+                                     std::chrono::milliseconds timeout)
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      _changed.wait_for(lock, timeout, [&]() { return responses_locked(id).size() >= n; });
+      return responses_locked(id);
+    }
+
+    static std::string id_of(bc::dict const &r)
+    {
+      auto it = r.find("id");
+      auto s = it != r.cend() ? std::get_if<bc::string>(&it->second) : nullptr;
+      return s != nullptr ? *s : "";
+    }
+
+    static bool has_status(bc::dict const &r, std::string const &status)
+    {
+      auto it = r.find("status");
+      auto l = it != r.cend() ? std::get_if<bc::list>(&it->second) : nullptr;
+      if(l == nullptr)
+      {
+        return false;
+      }
+      for(auto &s : *l)
+      {
+        if(auto v = std::get_if<bc::string>(&s); v && *v == status)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    static bool is_done(bc::dict const &r)
+    {
+      return has_status(r, "done");
+    }
+
+  private:
+    std::vector<bc::dict> responses_locked(std::string const &id)
+    {
+      std::vector<bc::dict> r;
+      for(auto &m : _responses)
+      {
+        if(id_of(m) == id)
+        {
+          r.push_back(m);
+        }
+      }
+      return r;
+    }
+
+    std::mutex _lock;
+    std::condition_variable _changed;
+    std::deque<bc::dict> _requests;
+    std::vector<bc::dict> _responses;
+    bool _hung_up{ false };
+  };
+
+  /** A test pod running its read loop on a thread, described already. */
+  class TestPod
+  {
+  public:
+    using Context = lotuc::pod::Context<json, test_pod::C>;
+    using Pod = lotuc::pod::PodImpl<json, test_pod::C>;
+
+    /** `configure` runs before the read loop starts. */
+    explicit TestPod(std::function<void(Context &, Pod &)> configure = nullptr,
+                     int max_concurrent = 4)
+      : ctx{ std::make_unique<Context>("test-pod",
+                                       components,
+                                       std::make_unique<lotuc::pod::JsonEncoder>(),
+                                       std::make_unique<MemoryTransport>(),
+                                       [this]() { cleanups++; }) }
+      , transport{ static_cast<MemoryTransport &>(*ctx->_transport) }
+      , pod{ *ctx, max_concurrent }
+    {
+      ctx->add_ns(test_pod::build_ns());
+      if(configure)
+      {
+        configure(*ctx, pod);
+      }
+      _loop = std::thread([this]() {
+        try
+        {
+          auto drained = pod.read_eval_loop();
+          std::lock_guard<std::mutex> lock(_lock);
+          _drained = drained;
+        }
+        catch(std::exception const &)
+        {
+          // the client hung up.
+        }
+        std::lock_guard<std::mutex> lock(_lock);
+        _ended = true;
+        _loop_ended.notify_all();
+      });
+      transport.send(bc::dict{ { "op", "describe" } });
+      transport.wait_for([](auto &r) { return r.contains("namespaces"); },
+                         std::chrono::seconds{ 5 });
+    }
+
+    /** Drains the invokes still running first, their workers use the pod. */
+    ~TestPod()
+    {
+      shutdown(std::chrono::seconds{ 5 });
+      transport.hang_up();
+      _loop.join();
+    }
+
+    TestPod(TestPod const &) = delete;
+    TestPod &operator=(TestPod const &) = delete;
+
+    /** Sends an invoke, `options` are the extra keys of the request. */
+    void invoke(std::string const &id,
+                std::string const &var,
+                json const &args,
+                bc::dict options = {})
+    {
+      options["op"] = "invoke";
+      options["id"] = id;
+      options["var"] = var;
+      options["args"] = args.dump();
+      transport.send(std::move(options));
+    }
+
+    /** Sends `shutdown`, returns whether the read loop reported a clean
+     * drain, or nothing if it didn't end within `timeout`.
+     */
+    std::optional<bool> shutdown(std::chrono::milliseconds timeout)
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      if(!_ended)
+      {
+        transport.send(bc::dict{ { "op", "shutdown" } });
+      }
+      if(!_loop_ended.wait_for(lock, timeout, [this]() { return _ended; }))
+      {
+        return std::nullopt;
+      }
+      return _drained;
+    }
+
+    test_pod::C components{};
+    std::atomic_int cleanups{ 0 };
+    std::unique_ptr<Context> ctx;
+    MemoryTransport &transport;
+    Pod pod;
+
+  private:
+    std::thread _loop;
+    std::mutex _lock;
+    std::condition_variable _loop_ended;
+    bool _ended{ false };
+    std::optional<bool> _drained{};
+  };
+}
+
+#endif // TEST_CLIENT_H_
@@ -0,0 +1,189 @@
+// Payload compression, see `pod_compress.h`: the codec is the first of the
+// describe request's `compression` list the pod has, values past the
+// threshold are sent compressed & compressed args are inflated. Without the
+// list the codec stays, without a codec compressed requests fail.
+
+#include "test_client.h"
+#include "test_support.h"
+
+#include <chrono>
+#include <optional>
+#include <string>
+
+namespace
+{
+  namespace bc = bencode;
+  namespace compress = lotuc::pod::compress;
+  using namespace std::chrono_literals;
+  using test_support::MemoryTransport;
+  using test_support::TestPod;
+
+  /** Sends a describe, `compression` its codec list if any. */
+  bc::dict describe(TestPod &p, std::optional<bc::list> compression = std::nullopt)
+  {
+    auto before = p.transport.responses("").size();
+    bc::dict request{
+      { "op", "describe" }
+    };
+    if(compression)
+    {
+      request["compression"] = std::move(*compression);
+    }
+    p.transport.send(std::move(request));
+    auto responses = p.transport.wait_count("", before + 1, 5s);
+    return responses.size() > before ? responses.back() : bc::dict{};
+  }
+
+  /** The describe response's `ops` `compression` dict, if offered. */
+  bc::dict const *compression_of(bc::dict const &described)
+  {
+    auto ops = described.find("ops");
+    auto d = ops != described.cend() ? std::get_if<bc::dict>(&ops->second) : nullptr;
+    auto c = d != nullptr ? d->find("compression") : bc::dict::const_iterator{};
+    return d != nullptr && c != d->cend() ? std::get_if<bc::dict>(&c->second) : nullptr;
+  }
+
+  std::optional<std::string> codec_of(bc::dict const &described)
+  {
+    auto c = compression_of(described);
+    auto it = c != nullptr ? c->find("codec") : bc::dict::const_iterator{};
+    if(c == nullptr || it == c->cend())
+    {
+      return std::nullopt;
+    }
+    return std::get<bc::string>(it->second);
+  }
+
+  /** The response's `key` payload, inflated if it was sent compressed. */
+  std::string payload(bc::dict const &r, std::string const &key, compress::Codec const &codec)
+  {
+    auto &s = std::get<bc::string>(r.at(key));
+    auto sizes = r.find("compressed");
+    if(sizes == r.cend())
+    {
+      return s;
+    }
+    auto size = std::get<bc::integer>(std::get<bc::dict>(sizes->second).at(key));
+    return codec.decompress(s, static_cast<std::size_t>(size));
+  }
+
+  json expected_range(int n)
+  {
+    auto v = json::array();
+    for(int i = 0; i < n; i++)
+    {
+      v.push_back(i);
+    }
+    return v;
+  }
+
+  void first_supported_codec_is_picked()
+  {
+    TestPod p;
+    auto &codecs = compress::codecs();
+    auto offered = describe(p);
+    if(codecs.empty())
+    {
+      CHECK(compression_of(offered) == nullptr);
+      return;
+    }
+    auto c = compression_of(offered);
+    CHECK(c != nullptr && std::get<bc::list>(c->at("codecs")).size() == codecs.size());
+    CHECK(!codec_of(offered));
+
+    // the client's preference, the names the pod lacks skipped.
+    auto preferred = std::string{ codecs.back()->name() };
+    CHECK(codec_of(describe(p, bc::list{ "nope", preferred })) == preferred);
+    // without the list, the codec stays.
+    CHECK(codec_of(describe(p)) == preferred);
+    // none the pod has, compression is off.
+    CHECK(!codec_of(describe(p, bc::list{ "nope" })));
+  }
+
+  void large_values_are_compressed()
+  {
+    auto &codecs = compress::codecs();
+    if(codecs.empty())
+    {
+      return;
+    }
+    auto &codec = *codecs.front();
+    TestPod p;
+    describe(p, bc::list{ std::string{ codec.name() } });
+
+    int const n = 5000;
+    p.invoke("large", "test-pod/large_range", json::array({ n }));
+    auto large = p.transport.wait_done("large", 5s);
+    CHECK(large.size() == 1);
+    if(large.size() == 1)
+    {
+      auto &r = large[0];
+      CHECK(r.contains("compressed"));
+      auto raw = payload(r, "value", codec);
+      CHECK(std::get<bc::string>(r.at("value")).size() < raw.size());
+      CHECK(json::parse(raw) == expected_range(n));
+    }
+
+    // below the threshold, sent as it is.
+    p.invoke("small", "test-pod/echo", json::array({ 42 }));
+    auto small = p.transport.wait_done("small", 5s);
+    CHECK(small.size() == 1);
+    CHECK(!small.empty() && !small[0].contains("compressed"));
+    CHECK(!small.empty() && std::get<bc::string>(small[0].at("value")) == "[42]");
+  }
+
+  void compressed_args_are_inflated()
+  {
+    auto &codecs = compress::codecs();
+    if(codecs.empty())
+    {
+      return;
+    }
+    auto &codec = *codecs.front();
+    TestPod p;
+    describe(p, bc::list{ std::string{ codec.name() } });
+
+    auto args = expected_range(2000).dump();
+    p.transport.send(bc::dict{
+      {         "op",                                                    "invoke" },
+      {         "id",                                                      "echo" },
+      {        "var",                                             "test-pod/echo" },
+      {       "args",                                       codec.compress(args) },
+      { "compressed", bc::dict{ { "args", static_cast<bc::integer>(args.size()) } } }
+    });
+    auto responses = p.transport.wait_done("echo", 5s);
+    CHECK(responses.size() == 1);
+    CHECK(!responses.empty() && !MemoryTransport::has_status(responses[0], "error"));
+    CHECK(!responses.empty() && payload(responses[0], "value", codec) == args);
+  }
+
+  void compressed_request_without_a_codec_fails()
+  {
+    TestPod p;
+    p.transport.send(bc::dict{
+      {         "op",                               "invoke" },
+      {         "id",                                 "echo" },
+      {        "var",                        "test-pod/echo" },
+      {       "args",                                "[42]" },
+      { "compressed", bc::dict{ { "args", bc::integer{ 4 } } } }
+    });
+    auto responses = p.transport.wait_done("echo", 5s);
+    CHECK(responses.size() == 1);
+    if(responses.size() == 1)
+    {
+      auto &r = responses[0];
+      CHECK(MemoryTransport::has_status(r, "error"));
+      auto message = std::get<bc::string>(r.at("ex-message"));
+      CHECK(message.find("compression was not negotiated") != std::string::npos);
+    }
+  }
+}
+
+int main()
+{
+  first_supported_codec_is_picked();
+  large_values_are_compressed();
+  compressed_args_are_inflated();
+  compressed_request_without_a_codec_fails();
+  return test_support::result();
+}
@@ -0,0 +1,79 @@
+// Graceful drain on `shutdown`, see `PodImpl::drain`: the invokes in flight
+// are answered before the read loop returns a clean shutdown; past the drain
+// timeout they get an error instead, once, & the shutdown is reported unclean.
+
+#include "test_client.h"
+#include "test_support.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace
+{
+  using namespace std::chrono_literals;
+  using clock = std::chrono::steady_clock;
+  using test_support::MemoryTransport;
+  using test_support::TestPod;
+
+  std::size_t count_done(std::vector<bencode::dict> const &responses)
+  {
+    std::size_t n{ 0 };
+    for(auto &r : responses)
+    {
+      n += MemoryTransport::is_done(r) ? 1 : 0;
+    }
+    return n;
+  }
+
+  void in_flight_invokes_finish()
+  {
+    TestPod p;
+    auto start = clock::now();
+    p.invoke("a", "test-pod/async_sleep", json::array({ 200 }));
+    p.invoke("b", "test-pod/async_sleep", json::array({ 300 }));
+    p.invoke("s", "test-pod/sleep", json::array({ 200 }));
+    p.invoke("e", "test-pod/echo", json::array({ 42 }));
+    auto drained = p.shutdown(5s);
+    CHECK(drained.has_value() && *drained);
+    CHECK(clock::now() - start >= 300ms);
+    for(auto id : { "a", "b", "s", "e" })
+    {
+      auto responses = p.transport.responses(id);
+      CHECK(count_done(responses) == 1);
+      for(auto &r : responses)
+      {
+        CHECK(!MemoryTransport::has_status(r, "error"));
+      }
+    }
+    auto echoed = p.transport.responses("e");
+    CHECK(!echoed.empty() && std::get<bencode::string>(echoed.back().at("value")) == "[42]");
+    CHECK(p.cleanups == 1);
+  }
+
+  void drain_timeout_abandons_the_rest()
+  {
+    TestPod p{ [](auto &, auto &pod) { pod.drain_timeout = 100ms; } };
+    p.invoke("quick", "test-pod/async_sleep", json::array({ 10 }));
+    p.invoke("slow", "test-pod/async_sleep", json::array({ 500 }));
+    auto start = clock::now();
+    auto drained = p.shutdown(5s);
+    CHECK(drained.has_value() && !*drained);
+    CHECK(clock::now() - start < 450ms);
+    CHECK(count_done(p.transport.responses("quick")) == 1);
+    auto slow = p.transport.responses("slow");
+    CHECK(slow.size() == 1);
+    CHECK(!slow.empty() && MemoryTransport::has_status(slow[0], "error"));
+    // the invoke finishing after the drain is not answered twice.
+    std::this_thread::sleep_for(600ms);
+    CHECK(p.transport.responses("slow").size() == 1);
+    CHECK(p.cleanups == 1);
+  }
+}
+
+int main()
+{
+  in_flight_invokes_finish();
+  drain_timeout_abandons_the_rest();
+  return test_support::result();
+}
@@ -1,6 +1,7 @@
 #include "pod.h"
 #include "test_ns.h"
 #include "pod_json.h"
+#include "pod_snapshot.h"
 #include "jsonrpc_transport.h"
 #include <memory>
 #include <sstream>
@@ -37,11 +38,35 @@ int main(int argc, char **argv)
   {
     transport = std::make_unique<pod::StdInOutLinedJsonTransport>();
   }
+  if(auto path = pod::getenv("POD_RECORD"); !path.empty())
+  {
+    transport = std::make_unique<pod::RecordingJsonRpcTransport>(std::move(transport), path);
+  }
   test_pod::C c{};
   std::unique_ptr<pod::Context<json, test_pod::C>> ctx
     = pod::build_jsonrpc_ctx<test_pod::C>(pod_id, c, transport.get(), nullptr);
   ctx->add_ns(test_pod::build_ns());
   ctx->add_ns(test_pod::build_defer_ns());
-  pod::build_pod(*ctx, max_concurrent).read_eval_loop();
+  if(auto snapshot = pod::getenv("POD_SNAPSHOT"); !snapshot.empty())
+  {
+    pod::warm_up_with_snapshot<json, test_pod::C>(
+      *ctx,
+      { snapshot, test_pod::save_components, test_pod::restore_components },
+      test_pod::build_components);
+  }
+  else
+  {
+    ctx->warm_up(test_pod::build_components);
+  }
+  auto p = pod::build_pod(*ctx, max_concurrent);
+  p.on_request_error = [](std::string const &id, std::string const &error) {
+    std::cerr << "pod: request " << (id.empty() ? "without id" : id) << " failed: " << error
+              << "\n";
+  };
+  if(!p.read_eval_loop())
+  {
+    // invokes still running use the pod & context, don't tear them down.
+    std::_Exit(1);
+  }
   return 0;
 }
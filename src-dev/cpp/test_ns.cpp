@@ -1,7 +1,31 @@
 #include "test_ns.h"
+#include "pod_shm.h"
 
 namespace test_pod
 {
+  void build_components(C &c)
+  {
+    // opt in, a big table slows every start down (4194304 entries: 32 MiB).
+    auto entries = lotuc::pod::getenv("POD_TABLE");
+    c.table.resize(entries.empty() ? 0 : std::stoull(entries));
+    for(size_t i = 0; i < c.table.size(); i++)
+    {
+      c.table[i] = static_cast<long long>(i) * static_cast<long long>(i);
+    }
+  }
+
+  std::string save_components(C const &c)
+  {
+    auto p = reinterpret_cast<char const *>(c.table.data());
+    return std::string(p, c.table.size() * sizeof(long long));
+  }
+
+  void restore_components(C &c, std::string_view image)
+  {
+    c.table.resize(image.size() / sizeof(long long));
+    std::memcpy(c.table.data(), image.data(), c.table.size() * sizeof(long long));
+  }
+
   void add_sync::derefer::deref()
   {
     int r{};
@@ -9,6 +33,7 @@ namespace test_pod
     {
       r += a.get<int>();
     }
+    ctx.components.add_calls.add();
     success(r);
   }
 
@@ -19,6 +44,7 @@ namespace test_pod
     {
       r += a.get<int>();
     }
+    ctx.components.add_calls.add();
     success(r);
   }
 
@@ -50,12 +76,39 @@ namespace test_pod
       end = args[1].get<int>();
       step = args[2].get<int>();
     }
-    for(int i = start; i < end; i += step)
+    if(start >= end)
     {
-      callback(i);
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      success();
+      return;
     }
-    success();
+
+    // paced by a timer, the invoke holds no thread between the values.
+    struct stream
+    {
+      std::mutex lock;
+      int next;
+      int end;
+      int step;
+      lotuc::pod::Timer timer;
+    };
+    auto s = std::make_shared<stream>();
+    s->next = start;
+    s->end = end;
+    s->step = step;
+    auto c = detach();
+    c->emit(s->next);
+    std::lock_guard<std::mutex> lock(s->lock);
+    s->timer = every(std::chrono::milliseconds(100), [s, c]() {
+      std::lock_guard<std::mutex> lock(s->lock);
+      s->next += s->step;
+      if(s->next < s->end)
+      {
+        c->emit(s->next);
+        return;
+      }
+      c->success();
+      s->timer.cancel();
+    });
   }
 
   void echo::derefer::deref()
@@ -121,6 +174,12 @@ namespace test_pod
     {
       return;
     }
+    else if(typ == "completion-dropped")
+    {
+      // detached, but the handle is never completed.
+      detach();
+      return;
+    }
     else
     {
       throw std::runtime_error{ "unkown mis-implementation-type: " + typ };
@@ -135,18 +194,102 @@ namespace test_pod
 
   void async_sleep::derefer::deref()
   {
-    std::this_thread::sleep_for(std::chrono::milliseconds(args[0].get<int>()));
-    success();
+    after(std::chrono::milliseconds(args[0].get<int>()), [c = detach()]() { c->success(); });
   }
 
   void counter_set::derefer::deref()
   {
-    ctx.components.counter = args[0].get<int>();
+    ctx.components.counter.store(args[0].get<int>());
     success();
   }
 
   void counter_get_inc::derefer::deref()
   {
-    success(ctx.components.counter++);
+    success(ctx.components.counter.fetch_add(1));
+  }
+
+  void large_range::derefer::deref()
+  {
+    int n = args[0].get<int>();
+    write_value("[");
+    for(int i = 0; i < n; i++)
+    {
+      write_value(i == 0 ? std::to_string(i) : "," + std::to_string(i));
+    }
+    write_value("]");
+    success_written();
+  }
+
+  void shm_sum::derefer::deref()
+  {
+    auto payload = lotuc::pod::resolve_shm(*ctx._encoder, args[0]);
+    if(!payload.has_value())
+    {
+      error("expecting a shm handle", { { "args", args } });
+      return;
+    }
+    unsigned long long sum{};
+    for(unsigned char c : payload->view())
+    {
+      sum += c;
+    }
+    success({
+      { "length", payload->size() },
+      {    "sum",             sum }
+    });
+  }
+
+  void shm_fill::derefer::deref()
+  {
+    auto region = lotuc::pod::ShmRegion::create(args[0].get<std::size_t>());
+    std::memset(region.data(), args[1].get<int>(), region.size());
+    success(ctx._encoder->make_shm_handle(region.handle()));
+  }
+
+  void table_get::derefer::deref()
+  {
+    success(ctx.components.table.at(args[0].get<size_t>()));
+  }
+
+  void add_calls::derefer::deref()
+  {
+    success(ctx.components.add_calls.sum());
+  }
+
+  void ticks::derefer::deref()
+  {
+    int n = args[0].get<int>();
+    for(int i = 0; i < n; i++)
+    {
+      emit(i);
+    }
+    success();
+  }
+
+  void upload_sum::derefer::deref()
+  {
+    if(input == nullptr)
+    {
+      error("expecting streamed args (the `args-stream` invoke option)");
+      return;
+    }
+    auto pause = std::chrono::milliseconds(args.empty() ? 0 : args[0].get<int>());
+    unsigned long long sum{};
+    std::size_t length{}, chunks{};
+    while(auto chunk = input->read())
+    {
+      for(unsigned char c : *chunk)
+      {
+        sum += c;
+      }
+      length += chunk->size();
+      chunks++;
+      std::this_thread::sleep_for(pause);
+    }
+    success({
+      { "length", length },
+      {    "sum",    sum },
+      { "chunks", chunks }
+    });
   }
 }
@@ -2,10 +2,13 @@
 #define TEST_POD_H_
 
 #include "pod.h"
+#include "pod_shard.h"
 #include <nlohmann/json.hpp>
 
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 using json = nlohmann::json;
 
@@ -15,9 +18,19 @@ namespace test_pod
 
   struct C
   {
-    int counter;
+    std::atomic_int counter;
+
+    // updated by every add-* invoke, sharded per worker thread
+    lotuc::pod::ShardedCounter add_calls;
+
+    // built at warm up (or restored from a snapshot), `POD_TABLE` entries
+    std::vector<long long> table;
   };
 
+  void build_components(C &c);
+  std::string save_components(C const &c);
+  void restore_components(C &c, std::string_view image);
+
   // invoking sync vars will block the Pod's read_eval_loop, while the async ones will not.
 
   // customize the var's name (notice the kebab case)
@@ -39,38 +52,52 @@ namespace test_pod
   define_pod_var_async(json, C, async_sleep, "{:doc \"(sleep ms)\"}");
   define_pod_var_async(json, C, counter_set, "");
   define_pod_var_async(json, C, counter_get_inc, "");
+  define_pod_var_async(json, C, large_range, "{:doc \"(large_range n), streams the result\"}");
+  define_pod_var_async(json, C, shm_sum, "{:doc \"(shm_sum handle), sums the payload bytes\"}");
+  define_pod_var_async(json, C, shm_fill, "{:doc \"(shm_fill n byte), returns a handle\"}");
+  define_pod_var_sync(json, C, table_get, "{:doc \"(table_get i), from the warmed up table\"}");
+  define_pod_var_sync(json, C, add_calls, "{:doc \"number of add-* invokes\"}");
+  define_pod_var_async(json, C, ticks, "{:doc \"(ticks n), streams 0..n-1 without pausing\"}");
+  define_pod_var_async(json, C, upload_sum, "{:doc \"(upload_sum ms), sums its streamed args\"}");
 
-  static void load_vars(lotuc::pod::Namespace<json, C> &ns)
-  {
-    ns.add_var(std::make_unique<add_sync>());
-    ns.add_var(std::make_unique<add_async>());
-    ns.add_var(std::make_unique<range_stream>());
-    ns.add_var(std::make_unique<error>());
-    ns.add_var(std::make_unique<echo>());
-    ns.add_var(std::make_unique<error>());
-    ns.add_var(std::make_unique<print>());
-    ns.add_var(std::make_unique<print_err>());
-    ns.add_var(std::make_unique<return_nil>());
-    ns.add_var(std::make_unique<do_twice>());
-    ns.add_var(std::make_unique<fn_call>());
-    ns.add_var(std::make_unique<multi_threaded_test>());
-    ns.add_var(std::make_unique<mis_implementation>());
-    ns.add_var(std::make_unique<sleep>());
-    ns.add_var(std::make_unique<async_sleep>());
-    ns.add_var(std::make_unique<counter_set>());
-    ns.add_var(std::make_unique<counter_get_inc>());
-  }
+  // registered at compile time
+  using test_pod_ns = lotuc::pod::StaticNamespace<json,
+                                                  C,
+                                                  "test-pod",
+                                                  add_sync,
+                                                  add_async,
+                                                  range_stream,
+                                                  echo,
+                                                  error,
+                                                  print,
+                                                  print_err,
+                                                  return_nil,
+                                                  do_twice,
+                                                  fn_call,
+                                                  multi_threaded_test,
+                                                  mis_implementation,
+                                                  sleep,
+                                                  async_sleep,
+                                                  counter_set,
+                                                  counter_get_inc,
+                                                  large_range,
+                                                  shm_sum,
+                                                  shm_fill,
+                                                  table_get,
+                                                  add_calls,
+                                                  ticks,
+                                                  upload_sum>;
 
   static std::unique_ptr<lotuc::pod::Namespace<json, C>> build_ns()
   {
-    auto ns = std::make_unique<lotuc::pod::Namespace<json, C>>("test-pod");
-    load_vars(*ns);
-    return ns;
+    return std::make_unique<test_pod_ns>();
   }
 
+  // the same vars, loaded on demand
   static std::unique_ptr<lotuc::pod::Namespace<json, C>> build_defer_ns()
   {
-    return std::make_unique<lotuc::pod::Namespace<json, C>>("test-pod-defer", true, load_vars);
+    return std::make_unique<lotuc::pod::Namespace<json, C>>(
+      "test-pod-defer", true, test_pod_ns::add_vars);
   }
 }
 
@@ -1,5 +1,9 @@
+// counts the invokes' heap allocations, see `pod_usage.h`
+#define LOTUC_POD_ALLOCATION_HOOK
 #include "test_ns.h"
 #include "pod_json.h"
+#include "pod_output.h"
+#include "pod_snapshot.h"
 
 int main(int argc, char **argv)
 {
@@ -7,17 +11,36 @@ int main(int argc, char **argv)
 
   std::cerr << "BABASHKA_POD: " << pod::getenv("BABASHKA_POD") << "\n";
   std::cerr << "BABASHKA_POD_TRANSPORT: " << pod::getenv("BABASHKA_POD_TRANSPORT") << "\n";
+  auto log_request_error = [](std::string const &id, std::string const &error) {
+    std::cerr << "pod: request " << (id.empty() ? "without id" : id) << " failed: " << error
+              << "\n";
+  };
 
   std::string pod_id{};
   int max_concurrent{ 2 };
+  bool adaptive{ false };
   if(argc > 1)
   {
     pod_id = argv[1];
   }
   if(argc > 2)
   {
-    std::stringstream ss(argv[2]);
-    ss >> max_concurrent;
+    // `auto`: the limit adapts to the observed latency.
+    adaptive = std::string{ argv[2] } == "auto";
+    if(!adaptive)
+    {
+      std::stringstream ss(argv[2]);
+      ss >> max_concurrent;
+    }
+  }
+
+  if(pod::getenv("POD_TRACE") == "true")
+  {
+    pod::trace::Tracer::instance().start();
+  }
+  if(auto f = pod::getenv("POD_TRACE_FILE"); !f.empty())
+  {
+    pod::trace::dump_on_signal(SIGUSR2, f);
   }
 
   test_pod::C c{};
@@ -25,6 +48,78 @@ int main(int argc, char **argv)
     = pod::build_json_ctx<test_pod::C>(pod_id, c);
   ctx->add_ns(test_pod::build_ns());
   ctx->add_ns(test_pod::build_defer_ns());
-  pod::build_pod(*ctx, max_concurrent).read_eval_loop();
+  pod::BufferedTransport *output{ nullptr };
+  if(auto capacity = pod::getenv("POD_OUTPUT_BUFFER"); !capacity.empty())
+  {
+    using policy = pod::BufferedTransport::Policy;
+    auto name = pod::getenv("POD_OUTPUT_POLICY");
+    auto buffered = std::make_unique<pod::BufferedTransport>(
+      std::move(ctx->_transport),
+      std::stoull(capacity),
+      name == "drop"       ? policy::drop_callbacks
+        : name == "coalesce" ? policy::coalesce_callbacks
+        : name == "fail"     ? policy::fail
+                             : policy::block);
+    output = buffered.get();
+    ctx->_transport = std::move(buffered);
+  }
+  if(auto limit = pod::getenv("POD_MEMORY_LIMIT"); !limit.empty())
+  {
+    ctx->memory.limit = std::stoull(limit);
+    ctx->memory.reject = pod::getenv("POD_MEMORY_REJECT") == "true";
+  }
+  if(auto workers = pod::getenv("POD_WORKERS"); !workers.empty() && !pod::is_prefork_worker())
+  {
+    using front_pod = pod::PreforkPod<json, test_pod::C>;
+    auto routing = pod::getenv("POD_ROUTING") == "by_var" ? front_pod::Routing::by_var
+      : pod::getenv("POD_ROUTING") == "by_args"           ? front_pod::Routing::by_args
+                                                          : front_pod::Routing::round_robin;
+    front_pod front{ *ctx, std::stoul(workers), { argv, argv + argc }, routing };
+    front.on_request_error = log_request_error;
+    if(!front.read_eval_loop())
+    {
+      // invokes still running use the pod & context, don't tear them down.
+      std::_Exit(1);
+    }
+    return 0;
+  }
+  if(auto snapshot = pod::getenv("POD_SNAPSHOT"); !snapshot.empty())
+  {
+    pod::warm_up_with_snapshot<json, test_pod::C>(
+      *ctx,
+      { snapshot, test_pod::save_components, test_pod::restore_components },
+      test_pod::build_components);
+  }
+  else
+  {
+    ctx->warm_up(test_pod::build_components);
+  }
+  if(auto ms = pod::getenv("POD_ARGS_TIMEOUT_MS"); !ms.empty())
+  {
+    ctx->args_timeout = std::chrono::milliseconds{ std::stoll(ms) };
+  }
+  if(auto threshold = pod::getenv("POD_COMPRESSION_THRESHOLD"); !threshold.empty())
+  {
+    ctx->compression_threshold = std::stoull(threshold);
+  }
+  if(pod::getenv("POD_PRELOAD") == "true")
+  {
+    ctx->preload();
+  }
+  auto p = pod::build_pod(*ctx, max_concurrent);
+  p.affinity = pod::Affinity::parse(pod::getenv("POD_AFFINITY"));
+  p.on_request_error = log_request_error;
+  if(output != nullptr)
+  {
+    output->pin_writer(p.affinity.writer);
+  }
+  if(adaptive)
+  {
+    p._concurrency_limiter.adapt(1, 1024);
+  }
+  if(!p.read_eval_loop())
+  {
+    std::_Exit(1);
+  }
   return 0;
 }
@@ -0,0 +1,37 @@
+#ifndef TEST_SUPPORT_H_
+#define TEST_SUPPORT_H_
+
+#include <atomic>
+#include <cstdio>
+
+// Checks for the test programs run by ctest (see CMakeLists.txt): a failed
+// `CHECK` is reported, the remaining ones still run & the program fails.
+
+namespace test_support
+{
+  inline std::atomic_int failures{ 0 };
+
+  inline void check(bool ok, char const *expr, char const *file, int line)
+  {
+    if(!ok)
+    {
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+      failures.fetch_add(1);
+    }
+  }
+
+  /** The program's exit status. */
+  inline int result()
+  {
+    if(auto n = failures.load(); n != 0)
+    {
+      std::fprintf(stderr, "%d check(s) failed\n", n);
+      return 1;
+    }
+    return 0;
+  }
+}
+
+#define CHECK(expr) test_support::check(static_cast<bool>(expr), #expr, __FILE__, __LINE__)
+
+#endif // TEST_SUPPORT_H_
@@ -0,0 +1,182 @@
+// Timer wheel & strands, see `pod_timer.h`: timers fire in order across the
+// levels (the ones past level 0 are cascaded down), cancelled timers never
+// fire, & a wheel may be destroyed from its own callback.
+
+#include "pod_timer.h"
+#include "test_support.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  namespace pod = lotuc::pod;
+  using namespace std::chrono_literals;
+  using clock = std::chrono::steady_clock;
+
+  /** The fired timers' names & times, since created. */
+  class Fired
+  {
+  public:
+    std::function<void()> record(int name)
+    {
+      return [this, name]() {
+        std::lock_guard<std::mutex> lock(_lock);
+        _fired.emplace_back(name, clock::now() - _start);
+        _changed.notify_all();
+      };
+    }
+
+    bool wait_for_count(std::size_t n, std::chrono::milliseconds timeout)
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      return _changed.wait_for(lock, timeout, [&]() { return _fired.size() >= n; });
+    }
+
+    std::vector<std::pair<int, clock::duration>> fired()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      return _fired;
+    }
+
+  private:
+    std::mutex _lock;
+    std::condition_variable _changed;
+    clock::time_point const _start{ clock::now() };
+    std::vector<std::pair<int, clock::duration>> _fired;
+  };
+
+  void fires_in_order_across_levels()
+  {
+    pod::TimerWheel wheel;
+    Fired f;
+    // level 0 covers 256 ms, the others are cascaded down when due.
+    wheel.after(600ms, f.record(600));
+    wheel.after(5ms, f.record(5));
+    wheel.after(300ms, f.record(300));
+    wheel.after(100ms, f.record(100));
+    CHECK(wheel.size() == 4);
+    CHECK(f.wait_for_count(4, 3s));
+    auto fired = f.fired();
+    CHECK(fired.size() == 4);
+    for(std::size_t i = 0; i < fired.size(); i++)
+    {
+      auto [name, at] = fired[i];
+      CHECK(i == 0 || fired[i - 1].first < name);
+      CHECK(at >= std::chrono::milliseconds{ name });
+      CHECK(at < std::chrono::milliseconds{ name } + 250ms);
+    }
+    CHECK(wheel.size() == 0);
+  }
+
+  void cancelled_timers_do_not_fire()
+  {
+    pod::TimerWheel wheel;
+    Fired f;
+    auto near = wheel.after(20ms, f.record(20));
+    auto far = wheel.after(400ms, f.record(400));
+    auto kept = wheel.after(450ms, f.record(450));
+    CHECK(near.cancel());
+    CHECK(!near.cancel());
+    // past the first cascade, the far timer sits in a level 0 slot by now.
+    std::this_thread::sleep_for(300ms);
+    CHECK(far.cancel());
+    CHECK(wheel.size() == 1);
+    CHECK(f.wait_for_count(1, 2s));
+    std::this_thread::sleep_for(100ms);
+    auto fired = f.fired();
+    CHECK(fired.size() == 1);
+    CHECK(!fired.empty() && fired[0].first == 450);
+    // a one shot timer that fired is gone.
+    CHECK(!kept.cancel());
+  }
+
+  void periodic_timers_repeat_until_cancelled()
+  {
+    pod::TimerWheel wheel;
+    Fired f;
+    auto t = wheel.every(10ms, f.record(0));
+    CHECK(f.wait_for_count(3, 2s));
+    CHECK(t.cancel());
+    // once `cancel` returned, the callback is not running.
+    auto n = f.fired().size();
+    std::this_thread::sleep_for(50ms);
+    CHECK(f.fired().size() == n);
+    CHECK(wheel.size() == 0);
+  }
+
+  void wheel_destroyed_from_its_callback()
+  {
+    auto destroyed = std::make_shared<std::promise<void>>();
+    auto gone = destroyed->get_future();
+    std::shared_ptr<pod::TimerWheel> wheel{ new pod::TimerWheel, [destroyed](auto w) {
+                                             delete w;
+                                             destroyed->set_value();
+                                           } };
+    // the callback owns the wheel's last reference, dropped on its thread.
+    wheel->after(5ms, [keep = wheel]() {});
+    wheel.reset();
+    CHECK(gone.wait_for(2s) == std::future_status::ready);
+  }
+
+  void strands_run_in_order()
+  {
+    pod::StrandPool pool{ 2 };
+    pod::Strand a{ pool };
+    pod::Strand b{ pool };
+    std::mutex lock;
+    std::vector<int> ran_a, ran_b;
+    std::atomic_int running_a{ 0 };
+    for(int i = 0; i < 100; i++)
+    {
+      a.post([&, i]() {
+        CHECK(running_a.fetch_add(1) == 0);
+        {
+          std::lock_guard<std::mutex> l(lock);
+          ran_a.push_back(i);
+        }
+        running_a.fetch_sub(1);
+      });
+      b.post([&, i]() {
+        std::lock_guard<std::mutex> l(lock);
+        ran_b.push_back(i);
+      });
+    }
+    auto deadline = clock::now() + 2s;
+    while(clock::now() < deadline)
+    {
+      {
+        std::lock_guard<std::mutex> l(lock);
+        if(ran_a.size() == 100 && ran_b.size() == 100)
+        {
+          break;
+        }
+      }
+      std::this_thread::sleep_for(1ms);
+    }
+    std::lock_guard<std::mutex> l(lock);
+    CHECK(ran_a.size() == 100);
+    CHECK(ran_b.size() == 100);
+    for(std::size_t i = 0; i < ran_a.size(); i++)
+    {
+      CHECK(ran_a[i] == static_cast<int>(i));
+    }
+  }
+}
+
+int main()
+{
+  fires_in_order_across_levels();
+  cancelled_timers_do_not_fire();
+  periodic_timers_repeat_until_cancelled();
+  wheel_destroyed_from_its_callback();
+  strands_run_in_order();
+  return test_support::result();
+}
@@ -3,8 +3,10 @@
 
 #include "bencode.hpp"
 #include "pod.h"
+#include "pod_record.h"
 
 #include <atomic>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <queue>
 #include <stdexcept>
@@ -24,6 +26,52 @@ namespace lotuc::pod
     virtual json read() = 0;
     virtual void write(json const &v) = 0;
     virtual ~JsonRpcTransport() = default;
+
+    /** Reads a message, `raw` is set to its line as read. By default the
+     * message is dumped back.
+     */
+    virtual json read_raw(std::string &raw)
+    {
+      auto v = read();
+      raw = v.dump();
+      return v;
+    }
+  };
+
+  /** Records the messages passing through a JSON-RPC transport, see
+   * `pod_record.h`. The written ones are logged under the lock of the writes,
+   * in the order they went out.
+   */
+  class RecordingJsonRpcTransport : public JsonRpcTransport
+  {
+  public:
+    RecordingJsonRpcTransport(std::unique_ptr<JsonRpcTransport> transport, std::string const &path)
+      : _transport{ std::move(transport) }
+      , _log{ path, 'j' }
+    {
+    }
+
+    json read() override
+    {
+      std::string raw;
+      auto v = _transport->read_raw(raw);
+      _log.record('<', raw);
+      return v;
+    }
+
+    void write(json const &v) override
+    {
+      // the transports write `dump()`, the same bytes.
+      auto line = v.dump();
+      std::lock_guard<std::mutex> lock(_write_lock);
+      _log.record('>', line);
+      _transport->write(v);
+    }
+
+  private:
+    std::unique_ptr<JsonRpcTransport> _transport;
+    recording::Writer _log;
+    std::mutex _write_lock;
   };
 
   class AdaptedBencodeTransport : public BencodeTransport
@@ -98,6 +146,19 @@ namespace lotuc::pod
       res["args"] = r["params"].dump();
       res["id"] = get_id(r);
 
+      // pod invoke options, as extension members of the request object.
+      for(auto k : { "batch-size", "batch-ms", "chunk-size", "priority" })
+      {
+        if(r.contains(k) && r[k].is_number_integer())
+        {
+          res[k] = r[k].get<bc::integer>();
+        }
+      }
+      if(r.contains("tag") && r["tag"].is_string())
+      {
+        res["tag"] = r["tag"].get<std::string>();
+      }
+
       return res;
     }
 
@@ -214,6 +275,12 @@ namespace lotuc::pod
             {    "ex-data",    ex_data }
           };
         }
+        else if(data.count("value-chunk"))
+        {
+          // chunks are not valid JSON values, they're passed as is.
+          tmp["type"] = "chunk";
+          tmp["chunk"] = std::get<std::string>(data["value-chunk"]);
+        }
         else
         {
           if(data.count("value"))
@@ -232,7 +299,10 @@ namespace lotuc::pod
         }
         else
         {
-          tmp["type"] = "partial";
+          if(!tmp.contains("type"))
+          {
+            tmp["type"] = "partial";
+          }
           res = {
             { "jsonrpc",                              "2.0" },
             {  "method", "lotuc.babashka.pods/notification" },
@@ -13,6 +13,12 @@ namespace lotuc::pod
     json read() override
     {
       std::string s{};
+      return read_raw(s);
+    }
+
+    json read_raw(std::string &s) override
+    {
+      s.clear();
       while(s.empty())
       {
         std::getline(std::cin, s);
@@ -61,8 +67,14 @@ namespace lotuc::pod
 
     json read() override
     {
-      _accept();
       std::string s{};
+      return read_raw(s);
+    }
+
+    json read_raw(std::string &s) override
+    {
+      _accept();
+      s.clear();
       while(s.empty())
       {
         std::getline(_stream, s);
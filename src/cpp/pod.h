@@ -2,16 +2,40 @@
 #define POD_H_
 
 #include "bencode.hpp"
-
+#include "pod_affinity.h"
+#include "pod_compress.h"
+#include "pod_profile.h"
+#include "pod_queue.h"
+#include "pod_timer.h"
+#include "pod_trace.h"
+#include "pod_usage.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
 #include <condition_variable>
 #include <cstddef>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <future>
+#include <iostream>
+#include <istream>
 #include <map>
 #include <memory>
 #include <optional>
 #include <stdexcept>
+#include <streambuf>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
 #include <utility>
+#include <variant>
 #include <vector>
 #include <set>
 #include <mutex>
@@ -44,6 +68,45 @@ namespace lotuc::pod
     return getenv("BABASHKA_POD_TRANSPORT") == "socket";
   }
 
+  /** Reads an optional integer option from a request frame, accepting both
+   * bencode integers and numeric strings. Throws if the option is not one, the
+   * invoke is rejected with the error. */
+  inline std::optional<long long> get_integer(bc::dict const &d, std::string const &k)
+  {
+    auto it = d.find(k);
+    if(it == d.cend())
+    {
+      return std::nullopt;
+    }
+    if(auto v = std::get_if<bc::integer>(&it->second); v)
+    {
+      return *v;
+    }
+    if(auto v = std::get_if<bc::string>(&it->second); v)
+    {
+      long long n{};
+      auto r = std::from_chars(v->data(), v->data() + v->size(), n);
+      if(r.ec == std::errc{} && r.ptr == v->data() + v->size())
+      {
+        return n;
+      }
+    }
+    throw std::invalid_argument{ "invalid integer option " + k };
+  }
+
+  /** Reads a string field of a request frame, throws if it's missing or not
+   * a string. */
+  inline std::string const &get_string(bc::dict const &d, std::string const &k)
+  {
+    auto it = d.find(k);
+    auto v = it != d.cend() ? std::get_if<bc::string>(&it->second) : nullptr;
+    if(v == nullptr)
+    {
+      throw std::invalid_argument{ "missing or invalid " + k };
+    }
+    return *v;
+  }
+
   struct ScopeGuard
   {
     // clang-format off
@@ -79,26 +142,314 @@ namespace lotuc::pod
     std::string ns_name;
     std::string var_name;
     std::string id;
-    T args;
+    // the invoke's derefer owns the args & outlives its pending entry.
+    T const *args;
     long long start_ts;
     std::future<void> fut;
+    // the args of invokes running elsewhere (prefork workers), when no
+    // decoded `args`.
+    std::string encoded_args{};
 
     PendingInvoke<T>(std::string const &ns_name,
                      std::string const &var_name,
                      std::string const &id,
-                     T const &args,
+                     T const *args,
                      long long start_ts,
                      std::future<void> fut)
       : ns_name{ ns_name }
       , var_name{ var_name }
       , id{ id }
-      , start_ts{ start_ts }
       , args{ args }
+      , start_ts{ start_ts }
       , fut{ std::move(fut) }
     {
     }
   };
 
+  /** One call of the builtin `invoke-many`. */
+  template <typename T>
+  struct InvokeCall
+  {
+    std::string var;
+    T args;
+  };
+
+  /** The outcome of an `invoke-many` call: its value, or its error. */
+  template <typename T>
+  struct InvokeResult
+  {
+    std::optional<T> value;
+    std::optional<std::string> ex_message;
+    std::optional<T> ex_data;
+    std::vector<T> callbacks;
+  };
+
+  /** A byte budget for the in-flight invokes: their args (estimated by the
+   * encoded size) & the output they gather with `write_value`. Once it's
+   * exceeded, new invokes wait for room, or are rejected when `reject` is
+   * set; an invoke is always admitted when nothing else is in flight.
+   * `limit` 0 means unlimited, only the usage is tracked.
+   */
+  class MemoryBudget
+  {
+  public:
+    std::size_t limit{ 0 };
+    bool reject{ false };
+
+    bool admit(std::size_t n)
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      auto fits = [this, n] { return limit == 0 || _current == 0 || _current + n <= limit; };
+      if(!fits())
+      {
+        if(reject)
+        {
+          return false;
+        }
+        _room.wait(lock, fits);
+      }
+      add(n);
+      return true;
+    }
+
+    /** Accounts bytes that are already allocated, never waits. */
+    void charge(std::size_t n)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      add(n);
+    }
+
+    void release(std::size_t n)
+    {
+      if(n == 0)
+      {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(_lock);
+      _current -= std::min(n, _current);
+      _room.notify_all();
+    }
+
+    std::map<std::string, long long> usage()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      return { { "current", static_cast<long long>(_current) },
+               { "peak", static_cast<long long>(_peak) },
+               { "limit", static_cast<long long>(limit) } };
+    }
+
+  private:
+    void add(std::size_t n)
+    {
+      _current += n;
+      _peak = std::max(_peak, _current);
+    }
+
+    std::mutex _lock;
+    std::condition_variable _room;
+    std::size_t _current{ 0 };
+    std::size_t _peak{ 0 };
+  };
+
+  /** The streamed args of an invoke, for inputs too big to be sent as one
+   * `args` string.
+   *
+   * The client opts in with the invoke option `args-stream`. The invoke starts
+   * with its leading `args` (if any), the input follows as `args-chunk`
+   * requests (`id` & `chunk`), ended by an `args-end` request. The var reads
+   * the chunks as they arrive, from its derefer's `input`.
+   *
+   * Memory is bounded by a credit window: the client may have at most `window`
+   * bytes sent that the var has not read yet (announced by the describe
+   * response, in the `args-chunk` op). The pod grants the read bytes back with
+   * `args-credit` responses. A chunk overrunning the window fails the stream,
+   * so does a client sending nothing for `timeout` while the var waits.
+   */
+  class ArgsStream
+  {
+  public:
+    ArgsStream(std::size_t window,
+               std::chrono::milliseconds timeout,
+               TimerWheel &timers,
+               MemoryBudget &memory,
+               std::function<void(std::size_t)> grant,
+               std::function<void()> on_close)
+      : _window{ window }
+      , _timeout{ timeout }
+      , _timers{ timers }
+      , _memory{ memory }
+      , _grant{ std::move(grant) }
+      , _on_close{ std::move(on_close) }
+    {
+    }
+
+    ArgsStream(ArgsStream const &) = delete;
+    ArgsStream &operator=(ArgsStream const &) = delete;
+
+    /** Queues a chunk from the client, never waits. Returns false if the
+     * chunk is dropped: the stream is closed, or the chunk overruns the window.
+     */
+    bool push(std::string chunk)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      if(_closed || _ended || !_error.empty())
+      {
+        return false;
+      }
+      if(_buffered + chunk.size() > _window)
+      {
+        fail_locked("args stream window exceeded");
+        return false;
+      }
+      _buffered += chunk.size();
+      _memory.charge(chunk.size());
+      _chunks.push_back(std::move(chunk));
+      _arrived.notify_all();
+      return true;
+    }
+
+    /** The client sent the last chunk. */
+    void end()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      _ended = true;
+      _arrived.notify_all();
+    }
+
+    /** Fails the reader, the buffered chunks are dropped. */
+    void fail(std::string const &message)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      fail_locked(message);
+    }
+
+    /** The next chunk, waits for it up to the timeout. Empty once the input
+     * ended, throws if the stream failed (or timed out: a stalled upload
+     * must not hold its invoke's slot forever).
+     */
+    std::optional<std::string> read()
+    {
+      std::string chunk;
+      std::size_t grant{ 0 };
+      {
+        std::unique_lock<std::mutex> lock(_lock);
+        auto ready = [this] { return !_chunks.empty() || _ended || _closed || !_error.empty(); };
+        if(!ready())
+        {
+          // the stall deadline is a timer of the wheel, armed while waiting.
+          lock.unlock();
+          auto deadline = _timers.after(_timeout, [this]() {
+            std::lock_guard<std::mutex> lock(_lock);
+            if(_chunks.empty() && !_ended && !_closed)
+            {
+              fail_locked("args stream timed out, no chunk for "
+                          + std::to_string(_timeout.count()) + " ms");
+            }
+          });
+          lock.lock();
+          _arrived.wait(lock, ready);
+          lock.unlock();
+          deadline.cancel();
+          lock.lock();
+        }
+        if(!_error.empty())
+        {
+          throw std::runtime_error{ _error };
+        }
+        if(_chunks.empty())
+        {
+          return std::nullopt;
+        }
+        chunk = std::move(_chunks.front());
+        _chunks.pop_front();
+        _buffered -= chunk.size();
+        _read += chunk.size();
+        // granted by halves of the window, not per chunk.
+        _ungranted += chunk.size();
+        if(!_ended && _ungranted >= std::max<std::size_t>(_window / 2, 1))
+        {
+          grant = std::exchange(_ungranted, 0);
+        }
+      }
+      _memory.release(chunk.size());
+      usage::add_in(chunk.size());
+      if(grant > 0)
+      {
+        _grant(grant);
+      }
+      return chunk;
+    }
+
+    /** Bytes read so far. */
+    std::size_t bytes_read()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      return _read;
+    }
+
+    /** The reader is done, the chunks still coming are dropped. */
+    void close()
+    {
+      {
+        std::lock_guard<std::mutex> lock(_lock);
+        if(_closed)
+        {
+          return;
+        }
+        _closed = true;
+        discard();
+        _arrived.notify_all();
+      }
+      _on_close();
+    }
+
+  private:
+    void fail_locked(std::string const &message)
+    {
+      if(_error.empty())
+      {
+        _error = message;
+      }
+      discard();
+      _arrived.notify_all();
+    }
+
+    void discard()
+    {
+      _memory.release(_buffered);
+      _buffered = 0;
+      _chunks.clear();
+    }
+
+    std::size_t const _window;
+    std::chrono::milliseconds const _timeout;
+    TimerWheel &_timers;
+    MemoryBudget &_memory;
+    std::function<void(std::size_t)> _grant;
+    std::function<void()> _on_close;
+
+    std::mutex _lock;
+    std::condition_variable _arrived;
+    std::deque<std::string> _chunks{};
+    std::size_t _buffered{ 0 };
+    std::size_t _read{ 0 };
+    std::size_t _ungranted{ 0 };
+    bool _ended{ false };
+    bool _closed{ false };
+    std::string _error{};
+  };
+
+  /** A payload placed in a shared memory file (see `pod_shm.h`). For local
+   * clients, big payloads can be passed by handle instead of being encoded
+   * into the messages.
+   */
+  struct ShmHandle
+  {
+    std::string path;
+    std::size_t offset;
+    std::size_t length;
+  };
+
   template <typename T>
   class Encoder
   {
@@ -122,6 +473,67 @@ namespace lotuc::pod
     virtual T make_dict(std::string const &k, T const &v) = 0;
     virtual std::string encode(std::vector<std::string> const &status) = 0;
     virtual std::string encode(std::vector<PendingInvoke<T> *> const &pendings) = 0;
+
+    // The encodings below back the later features (the builtin vars,
+    // invoke-many, shared memory). They default to unsupported, an encoder
+    // written against the core protocol keeps working & those invokes fail
+    // with the error.
+
+    /** Encodes named counters/metrics as a dict. */
+    virtual std::string encode(std::map<std::string, long long> const &)
+    {
+      throw unsupported("encode(metrics)");
+    }
+
+    /** Encodes groups of named metrics as a dict of dicts. */
+    virtual std::string encode(std::map<std::string, std::map<std::string, long long>> const &)
+    {
+      throw unsupported("encode(groups)");
+    }
+
+    /** Encodes the values as one list without building the list value. */
+    virtual std::string encode_list(std::vector<T> const &)
+    {
+      throw unsupported("encode_list");
+    }
+
+    /** The calls of an `invoke-many` argument: a list of `{var, args}`
+     * entries. Throws if malformed.
+     */
+    virtual std::vector<InvokeCall<T>> invoke_calls(T const &)
+    {
+      throw unsupported("invoke_calls");
+    }
+
+    /** The arguments of a builtin var taking numbers. Throws if one is not. */
+    virtual std::vector<double> numbers(T const &)
+    {
+      throw unsupported("numbers");
+    }
+
+    virtual std::string encode(std::vector<InvokeResult<T>> const &)
+    {
+      throw unsupported("encode(results)");
+    }
+
+    /** Returns the shared memory handle if the value is one, never by
+     * default: handles are passed as plain values.
+     */
+    virtual std::optional<ShmHandle> shm_handle(T const &)
+    {
+      return std::nullopt;
+    }
+
+    virtual T make_shm_handle(ShmHandle const &)
+    {
+      throw unsupported("make_shm_handle");
+    }
+
+  protected:
+    std::logic_error unsupported(std::string const &what) const
+    {
+      return std::logic_error{ "encoder " + format + " does not support " + what };
+    }
   };
 
   class BencodeTransport
@@ -130,8 +542,114 @@ namespace lotuc::pod
     virtual ~BencodeTransport() = default;
     virtual bc::data read() = 0;
     virtual void write(bc::data const &d) = 0;
+
+    /** Reads a frame & appends its bytes to `raw`, for taps (see
+     * `pod_record.h`). By default the frame is encoded back.
+     */
+    virtual bc::data read_raw(std::string &raw)
+    {
+      auto d = read();
+      raw += bc::encode(d);
+      return d;
+    }
+
+    /** Writes an already bencoded frame. */
+    virtual void write_encoded(std::string_view frame)
+    {
+      write(bc::decode(frame.begin(), frame.end()));
+    }
+
+    /** Whether `write_encoded` writes the bytes as they are. Transports that
+     * don't (the default decodes the frame back) are written dicts instead.
+     */
+    virtual bool writes_encoded() const
+    {
+      return false;
+    }
+
+    /** Blocks until the written frames are handed to the client. */
+    virtual void flush()
+    {
+    }
+
+    /** Gives up on the client: stops the I/O, unblocking a write it does not
+     * read. A no-op for the transports that can't.
+     */
+    virtual void close()
+    {
+    }
+
+    /** Whether the transport gave up on the client, a write may be left
+     * blocked in it.
+     */
+    virtual bool closed() const
+    {
+      return false;
+    }
+
+    /** Output metrics of the transport, if it keeps any. */
+    virtual std::map<std::string, long long> stats()
+    {
+      return {};
+    }
   };
 
+  namespace bencoded
+  {
+    inline void append_string(std::string &out, std::string_view s)
+    {
+      char len[24];
+      auto r = std::to_chars(len, len + sizeof(len), s.size());
+      out.append(len, r.ptr);
+      out += ':';
+      out.append(s);
+    }
+
+    /** An unbuffered view of a stream buffer, the bytes taken from it are
+     * appended to `tap`. The last one can be put back.
+     */
+    class TapBuf : public std::streambuf
+    {
+    public:
+      TapBuf(std::streambuf *source, std::string &tap)
+        : _source{ source }
+        , _tap{ tap }
+      {
+      }
+
+    protected:
+      int_type underflow() override
+      {
+        return _source->sgetc();
+      }
+
+      int_type uflow() override
+      {
+        auto c = _source->sbumpc();
+        if(!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+          _last = traits_type::to_char_type(c);
+          _tap.push_back(_last);
+          setg(&_last, &_last + 1, &_last + 1);
+        }
+        return c;
+      }
+
+    private:
+      std::streambuf *_source;
+      std::string &_tap;
+      char _last{};
+    };
+
+    /** Decodes a frame from `in`, its bytes as read are appended to `raw`. */
+    inline bc::data decode_some(std::istream &in, std::string &raw)
+    {
+      TapBuf tap{ in.rdbuf(), raw };
+      std::istream tapped{ &tap };
+      return bc::decode_some(tapped, bc::no_check_eof);
+    }
+  }
+
   template <typename T>
   class PodTransport
   {
@@ -143,6 +661,7 @@ namespace lotuc::pod
                     std::unique_ptr<Encoder<T>> encoder)
       : _transport{ std::move(transport) }
       , _encoder{ std::move(encoder) }
+      , _encoded_empty_dict{ _encoder->encode(_encoder->empty_dict()) }
     {
     }
 
@@ -151,23 +670,106 @@ namespace lotuc::pod
       return _encoder->format;
     }
 
+    /** Payload strings shorter than this are sent as they are, once a codec
+     * is negotiated (see `pod_compress.h`).
+     */
+    std::size_t compression_threshold{ 4096 };
+
+    /** Picks the first codec of a describe request's `compression` list the
+     * pod supports. Without the list, the negotiated codec (if any) stays.
+     */
+    void negotiate_compression(bc::dict const &request)
+    {
+      auto it = request.find("compression");
+      auto names = it != request.cend() ? std::get_if<bc::list>(&it->second) : nullptr;
+      if(names == nullptr)
+      {
+        return;
+      }
+      compress::Codec const *codec{ nullptr };
+      for(auto &name : *names)
+      {
+        if(auto n = std::get_if<bc::string>(&name); n && (codec = compress::find(*n)))
+        {
+          break;
+        }
+      }
+      _codec.store(codec);
+    }
+
+    compress::Codec const *codec() const
+    {
+      return _codec.load();
+    }
+
+    /** Reads a request, its compressed payloads inflated. A payload that
+     * can't be is dropped & the reason set as `compression-error`.
+     */
     bc::data read()
     {
-      return _transport->read();
+      auto d = _transport->read();
+      if(auto m = std::get_if<bc::dict>(&d); m && m->contains("compressed"))
+      {
+        inflate(*m);
+      }
+      return d;
     }
 
     void write(bc::data const &d)
     {
+      auto m = std::get_if<bc::dict>(&d);
+      if(m != nullptr && routing())
+      {
+        auto id = m->find("id");
+        auto s = id != m->cend() ? std::get_if<bc::string>(&id->second) : nullptr;
+        auto to = s != nullptr ? target(*s) : _transport.get();
+        if(to != _transport.get())
+        {
+          if(to != nullptr)
+          {
+            to->write(d);
+          }
+          return;
+        }
+      }
+      if(m != nullptr && _codec.load() != nullptr
+         && (m->contains("value") || m->contains("value-chunk")))
+      {
+        write_payload(*m, m->contains("value") ? "value" : "value-chunk");
+        return;
+      }
       _transport->write(d);
     }
 
+    /** Writes an already bencoded frame, one without payload. */
+    void write_encoded(std::string_view frame)
+    {
+      _transport->write_encoded(frame);
+    }
+
+    void flush()
+    {
+      _transport->flush();
+    }
+
+    bool closed() const
+    {
+      return _transport->closed();
+    }
+
     /** https://github.com/babashka/pods?tab=readme-ov-file#out-and-err
      *
      * Sending message to stderr.
      */
     void send_stderr(std::string const &id, std::string const &msg) const
     {
-      _transport->write(bc::dict{
+      auto to = target(id);
+      if(to == nullptr)
+      {
+        return;
+      }
+      usage::add_out(msg.size());
+      to->write(bc::dict{
         {  "id",  id },
         { "err", msg }
       });
@@ -179,7 +781,13 @@ namespace lotuc::pod
      */
     void send_stdout(std::string const &id, std::string const &msg) const
     {
-      _transport->write(bc::dict{
+      auto to = target(id);
+      if(to == nullptr)
+      {
+        return;
+      }
+      usage::add_out(msg.size());
+      to->write(bc::dict{
         {  "id",  id },
         { "out", msg }
       });
@@ -190,23 +798,34 @@ namespace lotuc::pod
      * Sending invoke error response.
      */
     void
-    send_invoke_error(std::string const &id, std::string const &ex_message, T const &ex_data) const
+    send_invoke_error(std::string const &id, std::string_view ex_message, T const &ex_data) const
     {
-      auto valid = _encoder->is_dict(ex_data);
-      if(!valid)
+      if(_encoder->is_dict(ex_data))
       {
-        send_stderr(id, "automatically wrapping non-dict error data, try fix the implementation");
+        send_invoke_error_encoded(id, ex_message, _encoder->encode(ex_data));
+        return;
       }
-      bc::data d = _encoder->encode(
-        valid ? ex_data : _encoder->make_dict("ex-data", _encoder->encode(ex_data)));
-      send_invoke_error_bc(id, ex_message, d);
+      warn_wrapping_error_data(id);
+      send_invoke_error_encoded(
+        id, ex_message, _encoder->encode(_encoder->make_dict("ex-data", _encoder->encode(ex_data))));
+    }
+
+    /** Sending invoke error response with empty error data. */
+    void send_invoke_error(std::string const &id, std::string_view ex_message) const
+    {
+      send_invoke_error_encoded(id, ex_message, _encoded_empty_dict);
     }
 
     void send_invoke_error_bc(std::string const &id,
                               std::string const &ex_message,
                               bc::data const &ex_data) const
     {
-      _transport->write(bc::dict{
+      auto to = target(id);
+      if(to == nullptr)
+      {
+        return;
+      }
+      to->write(bc::dict{
         {         "id",                          id },
         { "ex-message",                  ex_message },
         {    "ex-data",                     ex_data },
@@ -214,22 +833,57 @@ namespace lotuc::pod
       });
     }
 
+    /** The error path skips building the response dict, the frame is
+     * assembled in a per thread buffer around the constant parts.
+     */
+    void send_invoke_error_encoded(std::string const &id,
+                                   std::string_view ex_message,
+                                   std::string_view encoded_ex_data) const
+    {
+      auto to = target(id);
+      if(to == nullptr)
+      {
+        return;
+      }
+      if(!to->writes_encoded())
+      {
+        trace::Span span{ "write", id };
+        send_invoke_error_bc(id, std::string{ ex_message }, std::string{ encoded_ex_data });
+        return;
+      }
+      thread_local std::string frame;
+      frame.clear();
+      frame += "d7:ex-data";
+      bencoded::append_string(frame, encoded_ex_data);
+      frame += "10:ex-message";
+      bencoded::append_string(frame, ex_message);
+      frame += "2:id";
+      bencoded::append_string(frame, id);
+      frame += "6:statusl4:done5:erroree";
+      usage::add_out(frame.size());
+      trace::Span span{ "write", id };
+      to->write_encoded(frame);
+    }
+
     /** https://github.com/babashka/pods?tab=readme-ov-file#invoke
      *
      * Sending invoke success response.
      */
     void send_invoke_success(std::string const &id, T const &value) const
     {
-      send_invoke_success_bc(id, _encoder->encode(value));
+      send_invoke_success_bc(id, encode(id, value));
     }
 
     void send_invoke_success_bc(std::string const &id, bc::data const &value) const
     {
-      _transport->write(bc::dict{
-        {     "id",                 id },
-        {  "value",              value },
-        { "status", bc::list{ "done" } }
-      });
+      usage::add_out(size_of(value));
+      trace::Span span{ "write", id };
+      write_payload(bc::dict{
+                      {     "id",                 id },
+                      {  "value",              value },
+                      { "status", bc::list{ "done" } }
+      },
+                    "value");
     }
 
     /** https://github.com/babashka/pods/blob/47e55fe5e728578ff4dbf7d2a2caf00efea87b1e/test-pod/pod/test_pod.clj#L205
@@ -238,7 +892,12 @@ namespace lotuc::pod
      */
     void send_invoke_success(std::string const &id) const
     {
-      _transport->write(bc::dict{
+      auto to = target(id);
+      if(to == nullptr)
+      {
+        return;
+      }
+      to->write(bc::dict{
         {     "id",                 id },
         { "status", bc::list{ "done" } }
       });
@@ -251,22 +910,242 @@ namespace lotuc::pod
      */
     void send_invoke_callback(std::string const &id, T const &value) const
     {
-      send_invoke_callback_bc(id, _encoder->encode(value));
+      send_invoke_callback_bc(id, encode(id, value));
     }
 
     void send_invoke_callback_bc(std::string const &id, bc::data const &value) const
     {
-      _transport->write(bc::dict{
-        {     "id",         id },
-        {  "value",      value },
-        { "status", bc::list{} }
+      usage::add_out(size_of(value));
+      trace::Span span{ "write", id };
+      write_payload(bc::dict{
+                      {     "id",         id },
+                      {  "value",      value },
+                      { "status", bc::list{} }
+      },
+                    "value");
+    }
+
+    /** Sending a piece of a streamed (chunked) invoke result. The pieces'
+     * concatenation is the encoded value. The result is finished with a
+     * success response without value.
+     */
+    void send_invoke_value_chunk(std::string const &id, std::string chunk) const
+    {
+      usage::add_out(chunk.size());
+      write_payload(bc::dict{
+                      {          "id",              id },
+                      { "value-chunk", std::move(chunk) },
+                      {      "status",      bc::list{} }
+      },
+                    "value-chunk");
+    }
+
+    /** Grants the client `n` more bytes of an invoke's streamed args (see
+     * `ArgsStream`).
+     */
+    void send_args_credit(std::string const &id, std::size_t n) const
+    {
+      auto to = target(id);
+      if(to == nullptr)
+      {
+        return;
+      }
+      to->write(bc::dict{
+        {          "id",                             id },
+        { "args-credit", static_cast<bc::integer>(n) }
       });
     }
+
+    /** Sending several callback values within one callback response, the
+     * value is the list of them.
+     */
+    void send_invoke_callback_batch(std::string const &id, std::vector<T> const &values) const
+    {
+      send_invoke_callback_bc(id, _encoder->encode_list(values));
+    }
+
+    /** Answers the invoke with an error & drops its responses still to come,
+     * for invokes given up on (a timed out drain).
+     */
+    void abandon(std::string const &id, std::string_view ex_message)
+    {
+      send_invoke_error(id, ex_message);
+      std::lock_guard<std::mutex> lock(_routes_lock);
+      _closed_ids.insert(id);
+      _closing.store(true);
+    }
+
+    /** Sends the responses of the invokes `<id>/<index>` to `to` instead of
+     * the client, until `uncapture` (see `CaptureTransport`).
+     */
+    void capture(std::string const &id, BencodeTransport *to)
+    {
+      std::lock_guard<std::mutex> lock(_routes_lock);
+      _captures[id] = to;
+      _capturing.store(_captures.size());
+    }
+
+    void uncapture(std::string const &id)
+    {
+      std::lock_guard<std::mutex> lock(_routes_lock);
+      _captures.erase(id);
+      _capturing.store(_captures.size());
+    }
+
+  private:
+    std::string const _encoded_empty_dict;
+    std::atomic<compress::Codec const *> _codec{ nullptr };
+
+    mutable std::mutex _routes_lock;
+    std::set<std::string> _closed_ids{};
+    std::map<std::string, BencodeTransport *> _captures{};
+    std::atomic_bool _closing{ false };
+    std::atomic<std::size_t> _capturing{ 0 };
+
+    bool routing() const
+    {
+      return _closing.load(std::memory_order_relaxed)
+        || _capturing.load(std::memory_order_relaxed) > 0;
+    }
+
+    /** Where the responses of `id` go: the client, a capture, or nowhere
+     * (nullptr) once the invoke is abandoned.
+     */
+    BencodeTransport *target(std::string const &id) const
+    {
+      if(!routing())
+      {
+        return _transport.get();
+      }
+      std::lock_guard<std::mutex> lock(_routes_lock);
+      if(_closed_ids.contains(id))
+      {
+        return nullptr;
+      }
+      if(auto pos = id.rfind('/'); pos != std::string::npos)
+      {
+        if(auto it = _captures.find(id.substr(0, pos)); it != _captures.cend())
+        {
+          return it->second;
+        }
+      }
+      return _transport.get();
+    }
+
+    /** Writes the frame, its `key` payload compressed when it's worth it:
+     * the payload is replaced by the packed bytes, the frame's `compressed`
+     * dict maps the key to the raw size.
+     */
+    void write_payload(bc::dict frame, std::string const &key) const
+    {
+      if(routing())
+      {
+        auto id = std::get_if<bc::string>(&frame["id"]);
+        auto to = id != nullptr ? target(*id) : _transport.get();
+        if(to != _transport.get())
+        {
+          // captured frames are not compressed.
+          if(to != nullptr)
+          {
+            to->write(frame);
+          }
+          return;
+        }
+      }
+      auto codec = _codec.load();
+      auto raw = codec != nullptr ? std::get_if<bc::string>(&frame[key]) : nullptr;
+      if(raw != nullptr && raw->size() >= compression_threshold)
+      {
+        auto packed = codec->compress(*raw);
+        if(!packed.empty() && packed.size() < raw->size())
+        {
+          auto size = static_cast<bc::integer>(raw->size());
+          frame[key] = std::move(packed);
+          frame["compressed"] = bc::dict{
+            { key, size }
+          };
+        }
+      }
+      _transport->write(frame);
+    }
+
+    void inflate(bc::dict &frame) const
+    {
+      auto node = frame.extract("compressed");
+      auto sizes = std::get_if<bc::dict>(&node.mapped());
+      try
+      {
+        auto codec = _codec.load();
+        if(codec == nullptr)
+        {
+          throw std::runtime_error{ "compression was not negotiated" };
+        }
+        if(sizes == nullptr)
+        {
+          throw std::runtime_error{ "malformed sizes" };
+        }
+        for(auto &[key, size] : *sizes)
+        {
+          auto it = frame.find(key);
+          auto packed = it != frame.end() ? std::get_if<bc::string>(&it->second) : nullptr;
+          auto n = std::get_if<bc::integer>(&size);
+          if(packed == nullptr || n == nullptr || *n < 0)
+          {
+            throw std::runtime_error{ "malformed " + key };
+          }
+          *packed = codec->decompress(*packed, static_cast<std::size_t>(*n));
+        }
+      }
+      catch(std::exception const &e)
+      {
+        if(sizes != nullptr)
+        {
+          for(auto &[key, size] : *sizes)
+          {
+            frame.erase(key);
+          }
+        }
+        frame["compression-error"] = std::string{ "compressed payload: " } + e.what();
+      }
+    }
+
+    /** The accounted size of a response value, its encoded string. */
+    static std::size_t size_of(bc::data const &value)
+    {
+      auto s = std::get_if<bc::string>(&value);
+      return s != nullptr ? s->size() : 0;
+    }
+
+    std::string encode(std::string const &id, T const &value) const
+    {
+      trace::Span span{ "encode", id };
+      return _encoder->encode(value);
+    }
+
+    mutable std::atomic<long long> _last_wrapping_warning{};
+
+    /** Warns about the mis-implementation at most once a second, an erroring
+     * var should not double its responses.
+     */
+    void warn_wrapping_error_data(std::string const &id) const
+    {
+      auto now = std::chrono::duration_cast<std::chrono::seconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+                   .count();
+      auto last = _last_wrapping_warning.load(std::memory_order_relaxed);
+      if(now > last && _last_wrapping_warning.compare_exchange_strong(last, now))
+      {
+        send_stderr(id, "automatically wrapping non-dict error data, try fix the implementation");
+      }
+    }
   };
 
   template <typename T, typename C>
   class Var;
 
+  template <typename T, typename C>
+  class Completion;
+
   template <typename T, typename C>
   class Namespace
   {
@@ -283,9 +1162,34 @@ namespace lotuc::pod
     std::map<std::string, std::unique_ptr<Var<T, C>>> _vars;
     void add_var(std::unique_ptr<Var<T, C>> var);
 
+    /** Runs `load_vars` exactly once; concurrent callers wait for the loading
+     * one. `_vars` is only read after `_loaded` is published, and never
+     * written after that.
+     */
+    void load();
+
+    /** Loads the vars in the background, ahead of the `load-ns` request. */
+    void preload();
+
+    std::once_flag _load_once{};
+    std::atomic_bool _loaded{ false };
+    std::shared_future<void> _preloading{};
+
+    /** Static dispatch table & pre-encoded description, set by
+     * `StaticNamespace`. When set, `_vars` is unused.
+     */
+    std::vector<std::pair<std::string_view, Var<T, C> const *>> _static_vars{};
+    std::string_view _static_describe{};
+
+    /** find the `Var` by its name, returns `nullptr` if not found. */
+    Var<T, C> const *find_var(std::string const &name);
+
     bc::data describe();
     bc::data describe(bool force);
 
+    /** Appends the bencoded description, the static one as it is. */
+    void describe_to(std::string &out);
+
     Namespace(std::string const &name)
       : name(name)
       , defer{ false }
@@ -300,7 +1204,7 @@ namespace lotuc::pod
     {
       if(!defer)
       {
-        load_vars(*this);
+        load();
       }
     }
   };
@@ -313,6 +1217,7 @@ namespace lotuc::pod
 
     std::string const _pod_id;
     std::function<void()> const _cleanup;
+    mutable std::once_flag _cleaned_up;
 
     std::vector<std::string> _ns_names;
     std::map<std::string, std::unique_ptr<Namespace<T, C>>> _ns;
@@ -345,10 +1250,59 @@ namespace lotuc::pod
       cleanup();
     }
 
+    /** Component lifecycle: `warm_up` initializes the components in the
+     * background, overlapping with the `describe` handshake; invokes wait for
+     * it with `await_ready` (builtin vars don't). See also `pod_snapshot.h`
+     * for restoring the components from a prebuilt image.
+     */
+    void warm_up(std::function<void(C &)> init);
+
+    /** Waits for the components' warm up, rethrows its failure. */
+    void await_ready() const;
+
+    /** Cold start metrics, in milliseconds since the context's creation (or
+     * durations of the warm up steps), the first record of a name wins.
+     * Exposed by the builtin `startup` var.
+     */
+    void record_startup(std::string const &name, long long ms);
+    long long since_created_ms() const;
+    std::map<std::string, long long> startup_metrics();
+
+    std::chrono::steady_clock::time_point const _created{ std::chrono::steady_clock::now() };
+    std::shared_future<void> _ready{};
+    std::mutex _startup_lock;
+    std::map<std::string, long long> _startup{};
+
+    /** Bytes held by the in-flight invokes, exposed by the builtin `memory`
+     * var.
+     */
+    MemoryBudget memory{};
+
+    /** Runs the invokes' timer callbacks off the wheel's thread, see
+     * `Strand`. Declared first, it outlives the wheel posting to it.
+     */
+    StrandPool strands{};
+
+    /** Timers shared by the context's vars, see `pod_timer.h`. */
+    TimerWheel timers{};
+
+    /** The credit window of streamed args, per invoke (see `ArgsStream`). */
+    std::size_t args_window{ std::size_t{ 1 } << 20 };
+
+    /** How long a var reading streamed args waits for the next chunk before
+     * the invoke fails.
+     */
+    std::chrono::milliseconds args_timeout{ 30000 };
+
+    /** Detached invokes whose completion handle was dropped before they were
+     * completed, see `Completion`.
+     */
+    std::atomic<long long> abandoned{ 0 };
+
     /** https://github.com/babashka/pods?tab=readme-ov-file#describe
      *
      * If the pod supports `shutdown` op, we can customize the `cleanup`
-     * function on `shutdown`.
+     * function on `shutdown`. It runs once, the destructor doesn't repeat it.
      */
     //
     void cleanup() const;
@@ -367,6 +1321,9 @@ namespace lotuc::pod
     /** find namespace by its name. */
     Namespace<T, C> *find_ns(std::string const &name);
 
+    /** Starts loading every deferred namespace in the background. */
+    void preload();
+
     /** https://github.com/babashka/pods?tab=readme-ov-file#describe
      *
      * Returns the description info.
@@ -376,6 +1333,9 @@ namespace lotuc::pod
      * it for customizing `pod-id`.
      */
     bc::data describe(std::vector<std::unique_ptr<Namespace<T, C>>> &builtins);
+
+    /** `describe`'s response already bencoded, as the pod writes it. */
+    std::string describe_encoded(std::vector<std::unique_ptr<Namespace<T, C>>> &builtins);
   };
 
   /** A simple pod implementation. */
@@ -400,167 +1360,926 @@ namespace lotuc::pod
                         std::unique_ptr<typename Var<T, C>::derefer> derefer)
       = 0;
 
-    void read_eval_loop()
+    /** Called on `shutdown`, before the cleanup. Stops admitting invokes &
+     * waits for the running ones, returns false if some are still running.
+     */
+    virtual bool drain()
     {
-      auto &ctx = this->ctx;
-      while(true)
+      return true;
+    }
+
+    /** Admits an invoke whose args are still encoded in the request `frame`.
+     * By default, the args are decoded right away on the dispatching thread.
+     */
+    virtual void invoke_frame(Namespace<T, C> const &ns,
+                              Var<T, C> const &var,
+                              std::string const &id,
+                              bc::dict frame)
+    {
+      std::unique_ptr<typename Var<T, C>::derefer> derefer;
+      try
       {
-        auto d = std::get<bc::dict>(ctx.read());
-        auto op = std::get<bc::string>(d["op"]);
+        derefer = make_derefer(var, id, frame);
+      }
+      catch(std::exception const &e)
+      {
+        close_args_stream(id);
+        ctx.send_invoke_error(id, e.what());
+        return;
+      }
+      invoke(ns, var, std::move(derefer));
+    }
 
-        if(op == "invoke")
-        {
-          auto id = std::get<bc::string>(d["id"]);
-          auto qn = std::get<bc::string>(d["var"]);
-          std::optional<std::string> args = d.find("args") == d.cend()
-            ? std::nullopt
-            : std::make_optional(std::get<bc::string>(d["args"]));
-          auto found = ctx.find_var(qn);
-          auto ns = found.first;
-          auto var = found.second;
-          if(ns != nullptr && var != nullptr)
-          {
-            auto args_v
-              = args.has_value() ? ctx._encoder->decode(args.value()) : ctx._encoder->empty_list();
-            invoke(*ns, *var, std::move(var->make_derefer(ctx, id, args_v)));
-          }
-          else
-          {
-            ctx.send_invoke_error_bc(id, "var not found", bc::dict{});
-          }
-        }
-        else if(op == "describe")
+    /** Decodes the invoke's args & applies the invoke options. */
+    std::unique_ptr<typename Var<T, C>::derefer>
+    make_derefer(Var<T, C> const &var, std::string const &id, bc::dict const &frame)
+    {
+      std::optional<T> args_v{};
+      std::size_t bytes_in{ 0 };
+      {
+        trace::Span span{ "decode", id };
+        auto args = frame.find("args");
+        if(args != frame.cend())
         {
-          auto n = builtins();
-          auto v = ctx.describe(n);
-          ctx.write(v);
+          auto &encoded = std::get<bc::string>(args->second);
+          bytes_in = encoded.size();
+          args_v = ctx._encoder->decode(encoded);
         }
-        else if(op == "load-ns")
+        else
         {
-          auto name = std::get<bc::string>(d["ns"]);
-          auto ns = ctx.find_ns(name);
-          auto r = ns->describe(true);
-          auto id = d["id"];
-          r["id"] = id;
-          ctx.write(r);
+          args_v = ctx._encoder->empty_list();
         }
-        else if(op == "shutdown")
+      }
+      auto derefer = var.make_derefer(ctx, id, args_v.value());
+      derefer->usage.bytes_in = static_cast<long long>(bytes_in);
+      if(auto n = get_integer(frame, "batch-size"); n.has_value() && n.value() > 1)
+      {
+        derefer->batch_size = n.value();
+      }
+      if(auto ms = get_integer(frame, "batch-ms"); ms.has_value() && ms.value() > 0)
+      {
+        derefer->batch_window = std::chrono::milliseconds{ ms.value() };
+      }
+      if(auto n = get_integer(frame, "chunk-size"); n.has_value() && n.value() > 0)
+      {
+        derefer->chunk_size = n.value();
+      }
+      if(auto n = get_integer(frame, "priority"); n.has_value())
+      {
+        derefer->priority = static_cast<int>(n.value());
+      }
+      if(auto tag = frame.find("tag"); tag != frame.cend())
+      {
+        if(auto s = std::get_if<bc::string>(&tag->second); s)
         {
-          ctx.cleanup();
-          break;
+          derefer->tag = *s;
         }
-        else
+      }
+      if(frame.contains("args-stream"))
+      {
+        std::lock_guard<std::mutex> lock(_args_streams_lock);
+        if(auto it = _args_streams.find(id); it != _args_streams.end())
         {
-          break;
+          derefer->input = it->second;
         }
       }
+      return derefer;
     }
-  };
-
-  template <typename T, typename C>
-  class Var
-  {
-  public:
-    std::string const name;
-
-    /** https://github.com/babashka/pods?tab=readme-ov-file#metadata
-     *
-     * Fixed Metadata on vars
-     */
-    std::string const meta;
-
-    /** https://github.com/babashka/pods?tab=readme-ov-file#client-side-code
-     *
-     * Arbitrary code which will be executed under namespace `ns`.
-     */
-    std::string const code;
 
-    /** https://github.com/babashka/pods?tab=readme-ov-file#async
-     *
-     * reference implementation:
-     * https://github.com/babashka/pods/blob/47e55fe5e728578ff4dbf7d2a2caf00efea87b1e/test-pod/pod/test_pod.clj#L123
+    /** Registers the streamed args of an invoke, before it is handed out:
+     * its chunks may be dispatched before its derefer exists.
      */
-    bool const async;
-
-    Var(std::string const &name, std::string const &meta, std::string const &code, bool async)
-      : name{ name }
-      , meta{ meta }
-      , code{ code }
-      , async{ async }
+    void open_args_stream(std::string const &id)
     {
+      auto stream = std::make_shared<ArgsStream>(
+        ctx.args_window,
+        ctx.args_timeout,
+        ctx.timers,
+        ctx.memory,
+        [this, id](std::size_t n) { ctx.send_args_credit(id, n); },
+        [this, id]() { forget_args_stream(id); });
+      std::lock_guard<std::mutex> lock(_args_streams_lock);
+      _args_streams[id] = std::move(stream);
     }
 
-    virtual ~Var() = default;
-
-    bc::data describe()
+    /** Drops the streamed args of an invoke that failed before its derefer
+     * was made.
+     */
+    void close_args_stream(std::string const &id)
     {
-      auto v = bc::dict{
-        { "name", name }
-      };
-      if(!meta.empty())
+      std::shared_ptr<ArgsStream> stream;
       {
-        v["meta"] = meta;
+        std::lock_guard<std::mutex> lock(_args_streams_lock);
+        if(auto it = _args_streams.find(id); it != _args_streams.end())
+        {
+          stream = it->second;
+        }
       }
-      if(!code.empty())
+      if(stream != nullptr)
       {
-        v["code"] = code;
-      };
-      if(async)
-      {
-        v["async"] = "true";
+        stream->close();
       }
-      return v;
     }
 
-    class derefer
-    {
-    public:
-      Context<T, C> &ctx;
-      std::string id;
-      T args;
-      volatile bool done{ false };
-
-      // clang-format off
-
-      derefer(Context<T, C> &ctx, std::string const &id, T const &args)
-        : ctx(ctx) , id{ id } , args{ args } { }
+    /** The read loop is pipelined: a reader thread reads & frames the next
+     * requests while this thread dispatches the current one, the two are
+     * connected by bounded SPSC queues of `pipeline_depth` requests. Args are
+     * decoded by `invoke_frame`.
+     *
+     * Requests travel in two lanes, the `is_priority` ones are dispatched
+     * ahead of the queued user invokes.
+     */
+    bool pipelined{ true };
+    std::size_t pipeline_depth{ 256 };
 
-      void send_stdout(std::string const &msg) { ctx.send_stdout(id, msg); }
-      void sendln_stdout(std::string const &msg) { ctx.send_stdout(id, msg + "\n"); }
+    /** Told of the requests that failed without an invoke id to answer
+     * (e.g. a frame missing its `id`), with their id as sent (bencoded, empty
+     * if none) & the error. Unset, they're dropped.
+     */
+    std::function<void(std::string const &id, std::string const &error)> on_request_error{};
 
-      void send_stderr(std::string const &msg) { ctx.send_stderr(id, msg); }
-      void sendln_stderr(std::string const &msg) { ctx.send_stderr(id, msg + "\n"); }
+    /** Whether the `shutdown` was clean, see `read_eval_loop`. */
+    bool _drained{ true };
 
-      void callback(T const &v) { ctx.send_invoke_callback(id, v); }
+    /** Where the pod's threads run, see `pod_affinity.h`. The reader set pins
+     * the reader thread (the calling thread when not `pipelined`), the worker
+     * set pins the invoke threads, the writer set is for transports writing on
+     * their own thread.
+     */
+    Affinity affinity{};
 
-      void success() { ctx.send_invoke_success(id); done = true; }
+    std::mutex _args_streams_lock;
+    std::map<std::string, std::shared_ptr<ArgsStream>> _args_streams{};
 
-      void success(T const &v) { ctx.send_invoke_success(id, v); done = true; }
+    /** Whether some invoke's args are being streamed. */
+    bool args_streaming()
+    {
+      std::lock_guard<std::mutex> lock(_args_streams_lock);
+      return !_args_streams.empty();
+    }
 
-      void error(std::string const &ex_message, T const &ex_data)
-      {
-        ctx.send_invoke_error(id, ex_message, ex_data);
-        done = true;
-      }
+    void forget_args_stream(std::string const &id)
+    {
+      std::lock_guard<std::mutex> lock(_args_streams_lock);
+      _args_streams.erase(id);
+    }
 
-      void error(std::string const &ex_message)
+    /** Serves requests until `shutdown`. Returns false when the shutdown was
+     * not clean: invokes still running after the drain (they use the pod &
+     * context, keep them alive) or output the client did not read (a write
+     * may be blocked in the transport). The caller decides how to exit, e.g.
+     * `std::_Exit` with a failure status.
+     */
+    bool read_eval_loop()
+    {
+      if(!pipelined)
       {
-        ctx.send_invoke_error(id, ex_message, ctx._encoder->empty_dict());
-        done = true;
+        pin_current_thread(affinity.reader);
+        while(dispatch_request(read_request()))
+        {
+        }
+        return _drained;
       }
 
-      // clang-format on
-
-      virtual ~derefer() = default;
-
-      /** Triggers evaluation of the var. When returned, we expect `done` turn true. */
-      virtual void deref() = 0;
-    };
+      using item = std::variant<bc::dict, std::exception_ptr>;
+      LaneQueue<item> queue{ pipeline_depth };
+      std::atomic_bool stop{ false };
+      std::thread reader([this, &queue, &stop]() {
+        pin_current_thread(affinity.reader);
+        try
+        {
+          while(!stop.load())
+          {
+            auto d = read_request();
+            auto last = ends_loop(d);
+            auto high = is_priority(d);
+            queue.push(std::move(d), high);
+            if(last)
+            {
+              break;
+            }
+          }
+        }
+        catch(...)
+        {
+          queue.push(std::current_exception(), true);
+        }
+      });
+      // the loop only ends after the reader stopped by itself (it read the
+      // last request, or failed); otherwise it's stopped before its next
+      // read, a push blocked on a full lane is given room.
+      ScopeGuard _join{ [&]() {
+        stop.store(true);
+        while(queue.try_pop())
+        {
+        }
+        reader.join();
+      } };
 
-    virtual std::unique_ptr<derefer>
+      while(true)
+      {
+        auto v = queue.pop();
+        if(auto e = std::get_if<std::exception_ptr>(&v); e)
+        {
+          std::rethrow_exception(*e);
+        }
+        auto &d = std::get<bc::dict>(v);
+        if(ends_loop(d))
+        {
+          // the requests read before the last one are all queued by now, hand
+          // the invokes out before stopping.
+          while(auto rest = queue.try_pop_low())
+          {
+            dispatch_request(std::get<bc::dict>(std::move(rest.value())));
+          }
+        }
+        if(!dispatch_request(std::move(d)))
+        {
+          break;
+        }
+      }
+      return _drained;
+    }
+
+    /** Dispatches a request, a failing one is answered with the error (the
+     * invoke's error, or `on_request_error`) instead of ending the loop.
+     */
+    bool dispatch_request(bc::dict d)
+    {
+      auto it = d.find("id");
+      auto id = it != d.cend() ? std::get_if<bc::string>(&it->second) : nullptr;
+      std::string failed_id{ id != nullptr ? *id : "" };
+      std::string sent_id{ id == nullptr && it != d.cend() ? bc::encode(it->second) : "" };
+      auto last = ends_loop(d);
+      try
+      {
+        return dispatch(std::move(d));
+      }
+      catch(std::exception const &e)
+      {
+        if(!failed_id.empty())
+        {
+          ctx.send_invoke_error(failed_id, e.what());
+        }
+        else if(on_request_error)
+        {
+          on_request_error(sent_id, e.what());
+        }
+      }
+      return !last;
+    }
+
+    bc::dict read_request()
+    {
+      trace::Span span{ "read" };
+      auto d = std::get<bc::dict>(ctx.read());
+      if(auto it = d.find("id"); it != d.cend())
+      {
+        if(auto id = std::get_if<bc::string>(&it->second); id)
+        {
+          span.set_id(*id);
+        }
+      }
+      return d;
+    }
+
+    /** Whether the request goes in the high priority lane: the control ops,
+     * and invokes with a positive `priority` option. Streamed args follow
+     * their invoke in the low lane.
+     */
+    virtual bool is_priority(bc::dict const &d) const
+    {
+      auto it = d.find("op");
+      auto op = it != d.cend() ? std::get_if<bc::string>(&it->second) : nullptr;
+      if(op != nullptr && (*op == "args-chunk" || *op == "args-end"))
+      {
+        return false;
+      }
+      if(op == nullptr || *op != "invoke")
+      {
+        return true;
+      }
+      try
+      {
+        auto priority = get_integer(d, "priority");
+        return priority.has_value() && priority.value() > 0;
+      }
+      catch(std::invalid_argument const &)
+      {
+        // rejected when the invoke is dispatched.
+        return false;
+      }
+    }
+
+    /** Whether the loop stops after this request. */
+    static bool ends_loop(bc::dict const &d)
+    {
+      auto it = d.find("op");
+      auto op = it != d.cend() ? std::get_if<bc::string>(&it->second) : nullptr;
+      return op == nullptr
+             || (*op != "invoke" && *op != "describe" && *op != "load-ns" && *op != "args-chunk"
+                 && *op != "args-end");
+    }
+
+    /** Handles one request, returns false when the loop should stop. */
+    bool dispatch(bc::dict d)
+    {
+      auto &ctx = this->ctx;
+      auto op = get_string(d, "op");
+
+      if(op == "invoke")
+      {
+        auto id = get_string(d, "id");
+        auto qn = get_string(d, "var");
+        if(auto e = d.find("compression-error"); e != d.cend())
+        {
+          ctx.send_invoke_error(id, std::get<bc::string>(e->second));
+          return true;
+        }
+        std::pair<Namespace<T, C> const *, Var<T, C> const *> found{};
+        try
+        {
+          trace::Span span{ "find_var", id };
+          found = ctx.find_var(qn);
+        }
+        catch(std::exception const &e)
+        {
+          ctx.send_invoke_error(id, e.what());
+          return true;
+        }
+        auto ns = found.first;
+        auto var = found.second;
+        if(ns != nullptr && var != nullptr)
+        {
+          if(d.contains("args-stream"))
+          {
+            open_args_stream(id);
+          }
+          invoke_frame(*ns, *var, id, std::move(d));
+        }
+        else
+        {
+          ctx.send_invoke_error(id, "var not found");
+        }
+      }
+      else if(op == "args-chunk" || op == "args-end")
+      {
+        // a stream is registered until its reader closes it (the derefer
+        // may not exist yet), the chunks of a closed one are dropped.
+        auto id = get_string(d, "id");
+        std::shared_ptr<ArgsStream> stream;
+        {
+          std::lock_guard<std::mutex> lock(_args_streams_lock);
+          if(auto it = _args_streams.find(id); it != _args_streams.end())
+          {
+            stream = it->second;
+          }
+        }
+        auto chunk = d.find("chunk");
+        auto bytes = chunk != d.cend() ? std::get_if<bc::string>(&chunk->second) : nullptr;
+        if(auto e = d.find("compression-error"); e != d.cend())
+        {
+          if(stream != nullptr)
+          {
+            stream->fail(std::get<bc::string>(e->second));
+          }
+        }
+        else if(op == "args-chunk" && bytes == nullptr)
+        {
+          // the invoke is answered once: by its var, when it reads the
+          // failed stream.
+          if(stream != nullptr)
+          {
+            stream->fail("missing or invalid chunk");
+          }
+          else
+          {
+            ctx.send_invoke_error(id, "missing or invalid chunk");
+          }
+        }
+        else if(stream != nullptr && op == "args-chunk")
+        {
+          stream->push(std::move(*bytes));
+        }
+        else if(stream != nullptr)
+        {
+          stream->end();
+        }
+      }
+      else if(op == "describe")
+      {
+        ctx.negotiate_compression(d);
+        auto n = builtins();
+        ctx.write_encoded(ctx.describe_encoded(n));
+      }
+      else if(op == "load-ns")
+      {
+        auto id = get_string(d, "id");
+        auto ns = ctx.find_ns(get_string(d, "ns"));
+        auto r = std::get<bc::dict>(ns->describe(true));
+        r["id"] = id;
+        ctx.write(r);
+      }
+      else if(op == "shutdown")
+      {
+        // the chunks still expected will not be read.
+        {
+          std::lock_guard<std::mutex> lock(_args_streams_lock);
+          for(auto &[id, stream] : _args_streams)
+          {
+            stream->fail("pod is shutting down");
+          }
+        }
+        auto drained = drain();
+        ctx.flush();
+        ctx.cleanup();
+        _drained = drained && !ctx.closed();
+        return false;
+      }
+      else
+      {
+        return false;
+      }
+      return true;
+    }
+  };
+
+  template <typename T, typename C>
+  class Var
+  {
+  public:
+    std::string const name;
+
+    /** https://github.com/babashka/pods?tab=readme-ov-file#metadata
+     *
+     * Fixed Metadata on vars
+     */
+    std::string const meta;
+
+    /** https://github.com/babashka/pods?tab=readme-ov-file#client-side-code
+     *
+     * Arbitrary code which will be executed under namespace `ns`.
+     */
+    std::string const code;
+
+    /** https://github.com/babashka/pods?tab=readme-ov-file#async
+     *
+     * reference implementation:
+     * https://github.com/babashka/pods/blob/47e55fe5e728578ff4dbf7d2a2caf00efea87b1e/test-pod/pod/test_pod.clj#L123
+     */
+    bool const async;
+
+    Var(std::string const &name, std::string const &meta, std::string const &code, bool async)
+      : name{ name }
+      , meta{ meta }
+      , code{ code }
+      , async{ async }
+    {
+    }
+
+    virtual ~Var() = default;
+
+    bc::data describe()
+    {
+      auto v = bc::dict{
+        { "name", name }
+      };
+      if(!meta.empty())
+      {
+        v["meta"] = meta;
+      }
+      if(!code.empty())
+      {
+        v["code"] = code;
+      };
+      if(async)
+      {
+        v["async"] = "true";
+      }
+      return v;
+    }
+
+    class derefer
+    {
+    public:
+      Context<T, C> &ctx;
+      std::string id;
+      T args;
+      volatile bool done{ false };
+
+      // clang-format off
+
+      derefer(Context<T, C> &ctx, std::string const &id, T const &args)
+        : ctx(ctx) , id{ id } , args{ args } { }
+
+      void send_stdout(std::string const &msg) { ctx.send_stdout(id, msg); }
+      void sendln_stdout(std::string const &msg) { ctx.send_stdout(id, msg + "\n"); }
+
+      void send_stderr(std::string const &msg) { ctx.send_stderr(id, msg); }
+      void sendln_stderr(std::string const &msg) { ctx.send_stderr(id, msg + "\n"); }
+
+      void callback(T const &v) { ctx.send_invoke_callback(id, v); }
+
+      /** Sends the values as one callback, the callback value is a list. */
+      void callback_batch(std::vector<T> const &vs) { ctx.send_invoke_callback_batch(id, vs); }
+
+      void success() { flush(); ctx.send_invoke_success(id); done = true; }
+
+      void success(T const &v) { flush(); ctx.send_invoke_success(id, v); done = true; }
+
+      void error(std::string_view ex_message, T const &ex_data)
+      {
+        flush();
+        ctx.send_invoke_error(id, ex_message, ex_data);
+        done = true;
+      }
+
+      void error(std::string_view ex_message)
+      {
+        flush();
+        ctx.send_invoke_error(id, ex_message);
+        done = true;
+      }
+
+      // clang-format on
+
+      /** Callback coalescing for streaming vars, opted in by the client with
+       * the invoke options `batch-size` (max values per callback) and
+       * `batch-ms` (max time a value waits in the batch).
+       *
+       * Without the options, `emit` is the same as `callback`. With them,
+       * every callback value is a list of emitted values.
+       */
+      std::size_t batch_size{ 1 };
+      std::chrono::milliseconds batch_window{ 0 };
+
+      void emit(T const &v)
+      {
+        if(batch_size <= 1)
+        {
+          callback(v);
+          return;
+        }
+        std::lock_guard<std::mutex> lock(_batch_lock);
+        auto now = std::chrono::steady_clock::now();
+        if(_batch.empty())
+        {
+          _batch.reserve(batch_size);
+          _batch_start = now;
+        }
+        _batch.push_back(v);
+        if(batch_window.count() > 0 && !_batch_timer_armed)
+        {
+          // the window's deadline, the stream may go quiet.
+          arm_batch_timer(batch_window);
+        }
+        auto expired = batch_window.count() > 0 && now - _batch_start >= batch_window;
+        if(_batch.size() >= batch_size || expired)
+        {
+          callback_batch(_batch);
+          _batch.clear();
+        }
+      }
+
+      /** Sends the values emitted but not yet sent. */
+      void flush()
+      {
+        if(batch_size <= 1)
+        {
+          return;
+        }
+        std::lock_guard<std::mutex> lock(_batch_lock);
+        if(!_batch.empty())
+        {
+          callback_batch(_batch);
+          _batch.clear();
+        }
+      }
+
+      /** Bytes of the args accounted in `ctx.memory`, given back with the
+       * output's when the derefer is gone.
+       */
+      std::size_t charged{ 0 };
+
+      /** Outlives the derefer's own cleanup (e.g. the capture of an
+       * `invoke-many` call). It may own the last reference to the wheel or
+       * pool running it, which they allow.
+       */
+      std::shared_ptr<void> keep_alive{};
+
+      virtual ~derefer()
+      {
+        Timer batch_timer{};
+        {
+          std::lock_guard<std::mutex> lock(_batch_lock);
+          _batch_closed = true;
+          batch_timer = _batch_timer;
+        }
+        batch_timer.cancel();
+        if(_strand != nullptr)
+        {
+          _strand->close();
+        }
+        if(input != nullptr)
+        {
+          input->close();
+        }
+        ctx.memory.release(charged + _chunk_charged);
+      }
+
+      /** Runs `fn` after `delay` / every `period`, timed by the context's
+       * timer wheel, for pacing & periodic emission without holding a
+       * thread. `fn` may write: it runs on the invoke's strand, in order, not
+       * on the wheel's thread. The var cancels its timers before it
+       * finishes; the runs still queued then are dropped with the derefer.
+       */
+      Timer after(std::chrono::milliseconds delay, std::function<void()> fn)
+      {
+        return ctx.timers.after(delay, [s = strand(), fn = std::move(fn)]() { s->post(fn); });
+      }
+
+      Timer every(std::chrono::milliseconds period, std::function<void()> fn)
+      {
+        return ctx.timers.every(period, [s = strand(), fn = std::move(fn)]() { s->post(fn); });
+      }
+
+      /** Triggers evaluation of the var. When returned, we expect `done` turn
+       * true, unless the invoke was detached.
+       */
+      virtual void deref() = 0;
+
+      /** Detaches the invoke from `deref`: `deref` may return before the
+       * invoke is done, the returned handle completes it later, from any
+       * thread (see `Completion`). Called from `deref`.
+       */
+      std::shared_ptr<Completion<T, C>> detach();
+
+      bool detached() const { return _detached; }
+
+      /** The handle of a detached invoke, null once it's dropped. */
+      std::shared_ptr<Completion<T, C>> completion() const { return _completion.lock(); }
+
+      /** Streaming result for very large values. The var writes the encoded
+       * value piece by piece with `write_value` & finishes with
+       * `success_written`, so the whole value never needs to be in memory.
+       *
+       * If the client opted in with the invoke option `chunk-size`, pieces
+       * are sent as `value-chunk` responses of about that size. Otherwise
+       * they are gathered and sent as a normal success response.
+       */
+      std::size_t chunk_size{ 0 };
+
+      /** From the `priority` invoke option, the higher ones take the free
+       * concurrency slots first.
+       */
+      int priority{ 0 };
+
+      /** From the `tag` invoke option, the caller the usage is accounted to. */
+      std::string tag{};
+
+      /** The invoke's resource usage, see `pod_usage.h`. */
+      usage::Usage usage{};
+
+      /** The streamed args, when the client sent the invoke option
+       * `args-stream`, read them with `input->read()` (see `ArgsStream`).
+       */
+      std::shared_ptr<ArgsStream> input{};
+
+      void write_value(std::string_view encoded)
+      {
+        _chunk.append(encoded);
+        ctx.memory.charge(encoded.size());
+        _chunk_charged += encoded.size();
+        if(chunk_size > 0 && _chunk.size() >= chunk_size)
+        {
+          ctx.send_invoke_value_chunk(id, std::move(_chunk));
+          release_chunk();
+          _chunk.reserve(chunk_size);
+        }
+      }
+
+      void success_written()
+      {
+        flush();
+        if(chunk_size == 0)
+        {
+          ctx.send_invoke_success_bc(id, std::move(_chunk));
+        }
+        else
+        {
+          if(!_chunk.empty())
+          {
+            ctx.send_invoke_value_chunk(id, std::move(_chunk));
+          }
+          ctx.send_invoke_success(id);
+        }
+        release_chunk();
+        done = true;
+      }
+
+    private:
+      /** Where the timers' callbacks run, made by the first timer. The
+       * wheel's thread only posts to it: a write there would stall every
+       * timer behind a client that stops reading.
+       */
+      std::shared_ptr<Strand> strand()
+      {
+        std::call_once(_strand_once, [this]() { _strand = std::make_shared<Strand>(ctx.strands); });
+        return _strand;
+      }
+
+      /** One timer at a time (the latest is the one cancelled), it re-arms
+       * itself for a batch started after it was armed. Called under the
+       * batch lock.
+       */
+      void arm_batch_timer(std::chrono::milliseconds delay)
+      {
+        _batch_timer_armed = true;
+        _batch_timer = ctx.timers.after(delay, [this, s = strand()]() {
+          // the derefer waits for the strand before it's gone.
+          s->post([this]() { flush_batch_window(); });
+        });
+      }
+
+      void flush_batch_window()
+      {
+        std::lock_guard<std::mutex> lock(_batch_lock);
+        _batch_timer_armed = false;
+        if(_batch.empty() || _batch_closed)
+        {
+          return;
+        }
+        auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - _batch_start);
+        if(waited >= batch_window)
+        {
+          callback_batch(_batch);
+          _batch.clear();
+        }
+        else
+        {
+          arm_batch_timer(batch_window - waited);
+        }
+      }
+
+      void release_chunk()
+      {
+        ctx.memory.release(_chunk_charged);
+        _chunk_charged = 0;
+        _chunk = std::string{};
+      }
+
+      std::string _chunk{};
+      std::size_t _chunk_charged{ 0 };
+      std::mutex _batch_lock;
+      std::vector<T> _batch{};
+      std::chrono::steady_clock::time_point _batch_start{};
+      bool _batch_timer_armed{ false };
+      bool _batch_closed{ false };
+      bool _detached{ false };
+      std::weak_ptr<Completion<T, C>> _completion{};
+      Timer _batch_timer{};
+      std::once_flag _strand_once;
+      std::shared_ptr<Strand> _strand{};
+    };
+
+    virtual std::unique_ptr<derefer>
     make_derefer(Context<T, C> &ctx, std::string const &id, T const &args) const = 0;
   };
 
+  /** The handle of a detached invoke (`derefer::detach`), for vars waiting on
+   * an external event (a file watch, a socket, another event loop, a timer)
+   * without blocking a thread.
+   *
+   * Any thread may send callbacks & complete the invoke through it, the calls
+   * are serialized; calls after the completion are ignored & return false.
+   * The invoke holds its concurrency slot until `deref` returns only, it stays
+   * in the pendings (& is waited for by the drain) until completed. A handle
+   * dropped before completing is a leak: the invoke gets an error response &
+   * is counted in `Context::abandoned`.
+   */
+  template <typename T, typename C>
+  class Completion
+  {
+  public:
+    using derefer = typename Var<T, C>::derefer;
+    using finisher = std::function<void(std::unique_ptr<derefer>)>;
+
+    explicit Completion(derefer &d)
+      : _d{ d }
+    {
+    }
+
+    Completion(Completion const &) = delete;
+    Completion &operator=(Completion const &) = delete;
+
+    ~Completion()
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      if(_completed)
+      {
+        return;
+      }
+      _d.ctx.abandoned.fetch_add(1);
+      try
+      {
+        _d.error("invoke abandoned, its completion handle was dropped before completing");
+      }
+      catch(std::exception const &)
+      {
+        // the client is gone.
+      }
+      complete(lock);
+    }
+
+    // clang-format off
+
+    bool callback(T const &v) { return with([&](derefer &d) { d.callback(v); }); }
+    bool emit(T const &v) { return with([&](derefer &d) { d.emit(v); }); }
+    bool success() { return with([&](derefer &d) { d.success(); }); }
+    bool success(T const &v) { return with([&](derefer &d) { d.success(v); }); }
+    bool error(std::string_view ex_message) { return with([&](derefer &d) { d.error(ex_message); }); }
+
+    bool error(std::string_view ex_message, T const &ex_data)
+    {
+      return with([&](derefer &d) { d.error(ex_message, ex_data); });
+    }
+
+    // clang-format on
+
+    bool completed()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      return _completed;
+    }
+
+    /** Called by the pod once `deref` returned: the handle takes the
+     * derefer & finishes the invoke with `finish` when completed. Returns
+     * false (nothing taken) if it's completed already.
+     */
+    bool adopt(std::unique_ptr<derefer> &owned, finisher finish)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      if(_completed)
+      {
+        return false;
+      }
+      _owned = std::move(owned);
+      _finish = std::move(finish);
+      return true;
+    }
+
+  private:
+    std::mutex _lock;
+    derefer &_d;
+    bool _completed{ false };
+    std::unique_ptr<derefer> _owned{};
+    finisher _finish{};
+
+    template <typename F>
+    bool with(F f)
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      if(_completed)
+      {
+        return false;
+      }
+      f(_d);
+      if(_d.done)
+      {
+        complete(lock);
+      }
+      return true;
+    }
+
+    void complete(std::unique_lock<std::mutex> &)
+    {
+      _completed = true;
+      if(_finish)
+      {
+        auto finish = std::move(_finish);
+        finish(std::move(_owned));
+      }
+    }
+  };
+
+  template <typename T, typename C>
+  inline std::shared_ptr<Completion<T, C>> Var<T, C>::derefer::detach()
+  {
+    if(auto c = _completion.lock(); c)
+    {
+      return c;
+    }
+    if(_detached)
+    {
+      throw std::logic_error{ "invoke already detached" };
+    }
+    auto c = std::make_shared<Completion<T, C>>(*this);
+    _completion = c;
+    _detached = true;
+    return c;
+  }
+
   template <typename T, typename C>
   inline void Namespace<T, C>::add_var(std::unique_ptr<Var<T, C>> var)
   {
@@ -568,6 +2287,45 @@ namespace lotuc::pod
     _vars[n] = std::move(var);
   }
 
+  template <typename T, typename C>
+  inline void Namespace<T, C>::load()
+  {
+    if(!load_vars || _loaded.load(std::memory_order_acquire))
+    {
+      return;
+    }
+    std::call_once(_load_once, [this]() {
+      load_vars(*this);
+      _loaded.store(true, std::memory_order_release);
+    });
+  }
+
+  template <typename T, typename C>
+  inline void Namespace<T, C>::preload()
+  {
+    if(!load_vars || _loaded.load(std::memory_order_acquire) || _preloading.valid())
+    {
+      return;
+    }
+    _preloading = std::async(std::launch::async, [this]() { load(); }).share();
+  }
+
+  template <typename T, typename C>
+  inline Var<T, C> const *Namespace<T, C>::find_var(std::string const &name)
+  {
+    load();
+    if(!_static_vars.empty())
+    {
+      auto it = std::lower_bound(_static_vars.cbegin(),
+                                 _static_vars.cend(),
+                                 std::string_view{ name },
+                                 [](auto const &e, std::string_view n) { return e.first < n; });
+      return it != _static_vars.cend() && it->first == name ? it->second : nullptr;
+    }
+    auto it = _vars.find(name);
+    return it != _vars.cend() ? it->second.get() : nullptr;
+  }
+
   template <typename T, typename C>
   inline bc::data Namespace<T, C>::describe()
   {
@@ -577,6 +2335,10 @@ namespace lotuc::pod
   template <typename T, typename C>
   inline bc::data Namespace<T, C>::describe(bool force)
   {
+    if(!_static_describe.empty())
+    {
+      return bc::decode(_static_describe.begin(), _static_describe.end());
+    }
     bc::dict v = bc::dict{
       { "name", name }
     };
@@ -586,10 +2348,7 @@ namespace lotuc::pod
     }
     else
     {
-      if(load_vars)
-      {
-        load_vars(*this);
-      }
+      load();
       bc::list vars;
       for(auto &p : _vars)
       {
@@ -600,6 +2359,17 @@ namespace lotuc::pod
     return v;
   }
 
+  template <typename T, typename C>
+  inline void Namespace<T, C>::describe_to(std::string &out)
+  {
+    if(!_static_describe.empty())
+    {
+      out.append(_static_describe);
+      return;
+    }
+    out += bc::encode(describe());
+  }
+
   template <typename T, typename C>
   inline void Context<T, C>::add_ns(std::unique_ptr<Namespace<T, C>> ns)
   {
@@ -612,14 +2382,67 @@ namespace lotuc::pod
   }
 
   template <typename T, typename C>
-  inline void Context<T, C>::cleanup() const
+  inline void Context<T, C>::warm_up(std::function<void(C &)> init)
+  {
+    _ready = std::async(std::launch::async, [this, init = std::move(init)]() {
+               auto start = since_created_ms();
+               init(components);
+               record_startup("warm-up-ms", since_created_ms() - start);
+               record_startup("ready-ms", since_created_ms());
+             }).share();
+  }
+
+  template <typename T, typename C>
+  inline void Context<T, C>::await_ready() const
+  {
+    if(_ready.valid())
+    {
+      _ready.get();
+    }
+  }
+
+  template <typename T, typename C>
+  inline void Context<T, C>::record_startup(std::string const &name, long long ms)
+  {
+    std::lock_guard<std::mutex> lock(_startup_lock);
+    _startup.emplace(name, ms);
+  }
+
+  template <typename T, typename C>
+  inline long long Context<T, C>::since_created_ms() const
+  {
+    auto d = std::chrono::steady_clock::now() - _created;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+  }
+
+  template <typename T, typename C>
+  inline std::map<std::string, long long> Context<T, C>::startup_metrics()
+  {
+    std::lock_guard<std::mutex> lock(_startup_lock);
+    return _startup;
+  }
+
+  template <typename T, typename C>
+  inline void Context<T, C>::preload()
   {
-    if(_cleanup)
+    for(auto &p : _ns)
     {
-      _cleanup();
+      p.second->preload();
     }
   }
 
+  template <typename T, typename C>
+  inline void Context<T, C>::cleanup() const
+  {
+    // on `shutdown`, & again when the context is destroyed.
+    std::call_once(_cleaned_up, [this]() {
+      if(_cleanup)
+      {
+        _cleanup();
+      }
+    });
+  }
+
   template <typename T, typename C>
   inline Namespace<T, C> *Context<T, C>::find_ns(std::string const &name)
   {
@@ -639,119 +2462,617 @@ namespace lotuc::pod
     {
       throw std::runtime_error{ "invalid qualified name: " + qualified_name };
     }
-    auto _ns_name = qualified_name.substr(0, pos);
-    if(!_ns.contains(_ns_name))
+    auto _ns_name = qualified_name.substr(0, pos);
+    if(!_ns.contains(_ns_name))
+    {
+      throw std::runtime_error{ "namespace not found: " + qualified_name };
+    }
+    std::unique_ptr<Namespace<T, C>> &ns = _ns[_ns_name];
+
+    auto var = ns->find_var(qualified_name.substr(pos + 1));
+    if(var == nullptr)
+    {
+      throw std::runtime_error{ "namespace var not found: " + qualified_name };
+    }
+    return std::make_pair(ns.get(), var);
+  }
+
+  template <typename T, typename C>
+  inline bc::data
+  Context<T, C>::describe(std::vector<std::unique_ptr<Namespace<T, C>>> &builtins)
+  {
+    auto out = describe_encoded(builtins);
+    return bc::decode(out.begin(), out.end());
+  }
+
+  template <typename T, typename C>
+  inline std::string
+  Context<T, C>::describe_encoded(std::vector<std::unique_ptr<Namespace<T, C>>> &builtins)
+  {
+    record_startup("describe-ms", since_created_ms());
+
+    for(auto &ns : builtins)
+    {
+      add_ns(std::move(ns));
+    }
+
+    bc::dict ops{
+      { "args-chunk", bc::dict{ { "window", static_cast<bc::integer>(args_window) } } }
+    };
+    {
+      // the codecs on offer, & the one in use once negotiated.
+      bc::list codecs;
+      for(auto c : compress::codecs())
+      {
+        codecs.emplace_back(std::string{ c->name() });
+      }
+      if(!codecs.empty())
+      {
+        bc::dict compression{
+          { "codecs", std::move(codecs) }
+        };
+        if(auto c = this->codec(); c != nullptr)
+        {
+          compression["codec"] = std::string{ c->name() };
+          compression["threshold"] = static_cast<bc::integer>(this->compression_threshold);
+        }
+        ops["compression"] = std::move(compression);
+      }
+    }
+    {
+      if(_cleanup)
+      {
+        ops["shutdown"] = bc::dict{};
+      }
+    }
+
+    // assembled as bytes (keys in bencode's sorted order), the static
+    // namespaces' descriptions are copied in as they are.
+    std::string out{ "d6:format" };
+    bencoded::append_string(out, this->format());
+    out += "10:namespacesl";
+    {
+      if(!_pod_id.empty())
+      {
+        if(_ns.contains(_pod_id))
+        {
+          _ns[_pod_id]->describe_to(out);
+        }
+        else
+        {
+          out += bc::encode(bc::dict{
+            { "name", _pod_id }
+          });
+        }
+      }
+      for(auto &n : _ns_names)
+      {
+        if(n == _pod_id)
+        {
+          continue;
+        }
+        _ns[n]->describe_to(out);
+      }
+    }
+    out += "e3:ops";
+    out += bc::encode(ops);
+    out += 'e';
+    return out;
+  }
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  /** A string usable as template argument, `StaticNamespace<T, C, "ns", ...>`. */
+  template <std::size_t N>
+  struct fixed_string
+  {
+    char data[N]{};
+
+    constexpr fixed_string(char const (&s)[N])
+    {
+      std::copy_n(s, N, data);
+    }
+
+    constexpr std::string_view view() const
+    {
+      return { data, N - 1 };
+    }
+  };
+
+  namespace static_describe
+  {
+    /** Bencodes into `out`, or only counts the size when `out` is null. */
+    struct writer
+    {
+      char *out;
+      std::size_t n;
+
+      constexpr void put(char c)
+      {
+        if(out != nullptr)
+        {
+          out[n] = c;
+        }
+        n++;
+      }
+
+      constexpr void put(std::string_view s)
+      {
+        for(auto c : s)
+        {
+          put(c);
+        }
+      }
+
+      constexpr void string(std::string_view s)
+      {
+        char digits[24]{};
+        std::size_t i{};
+        auto len = s.size();
+        do
+        {
+          digits[i++] = static_cast<char>('0' + len % 10);
+          len /= 10;
+        } while(len > 0);
+        while(i > 0)
+        {
+          put(digits[--i]);
+        }
+        put(':');
+        put(s);
+      }
+    };
+
+    /** The vars' indexes sorted by name; duplicated names don't compile. */
+    template <typename... Vs>
+    consteval std::array<std::size_t, sizeof...(Vs)> sorted()
+    {
+      constexpr std::array<std::string_view, sizeof...(Vs)> names{ Vs::var_name... };
+      std::array<std::size_t, sizeof...(Vs)> order{};
+      for(std::size_t i = 0; i < order.size(); i++)
+      {
+        order[i] = i;
+      }
+      std::sort(order.begin(), order.end(), [&](auto a, auto b) { return names[a] < names[b]; });
+      for(std::size_t i = 1; i < order.size(); i++)
+      {
+        if(names[order[i - 1]] == names[order[i]])
+        {
+          throw "duplicated var name";
+        }
+      }
+      return order;
+    }
+
+    template <typename V>
+    constexpr void var(writer &w)
+    {
+      // keys in bencode's sorted order
+      w.put('d');
+      if(V::var_async)
+      {
+        w.string("async");
+        w.string("true");
+      }
+      if(!V::var_code.empty())
+      {
+        w.string("code");
+        w.string(V::var_code);
+      }
+      if(!V::var_meta.empty())
+      {
+        w.string("meta");
+        w.string(V::var_meta);
+      }
+      w.string("name");
+      w.string(V::var_name);
+      w.put('e');
+    }
+
+    template <fixed_string Name, typename... Vs>
+    constexpr void ns(writer &w)
+    {
+      using var_fn = void (*)(writer &);
+      constexpr std::array<var_fn, sizeof...(Vs)> vars{ &var<Vs>... };
+      w.put('d');
+      w.string("name");
+      w.string(Name.view());
+      w.string("vars");
+      w.put('l');
+      for(auto i : sorted<Vs...>())
+      {
+        vars[i](w);
+      }
+      w.put('e');
+      w.put('e');
+    }
+
+    template <fixed_string Name, typename... Vs>
+    consteval std::size_t size()
+    {
+      writer w{ nullptr, 0 };
+      ns<Name, Vs...>(w);
+      return w.n;
+    }
+
+    template <fixed_string Name, typename... Vs>
+    consteval std::array<char, size<Name, Vs...>()> encode()
+    {
+      std::array<char, size<Name, Vs...>()> r{};
+      writer w{ r.data(), 0 };
+      ns<Name, Vs...>(w);
+      return r;
+    }
+  }
+
+  /** A namespace whose vars are known at compile time.
+   *
+   *   StaticNamespace<json, C, "my-ns", var_a, var_b>
+   *
+   * The vars are classes defined with the `define_pod_var*` macros. The
+   * namespace description is encoded at compile time, and vars are found
+   * through a sorted table instead of the `_vars` map.
+   */
+  template <typename T, typename C, fixed_string Name, typename... Vs>
+  class StaticNamespace : public Namespace<T, C>
+  {
+  public:
+    static constexpr auto describe_bytes = static_describe::encode<Name, Vs...>();
+
+    StaticNamespace()
+      : Namespace<T, C>{ std::string{ Name.view() } }
+    {
+      using vars_t = std::array<Var<T, C> const *, sizeof...(Vs)>;
+      auto vars = std::apply([](auto const &...v) { return vars_t{ &v... }; }, _instances);
+      this->_static_vars.reserve(sizeof...(Vs));
+      for(auto i : static_describe::sorted<Vs...>())
+      {
+        this->_static_vars.emplace_back(vars[i]->name, vars[i]);
+      }
+      this->_static_describe = std::string_view{ describe_bytes.data(), describe_bytes.size() };
+    }
+
+    /** Adds instances of the vars to a namespace, e.g. as the `load_vars` of
+     * a deferred one.
+     */
+    static void add_vars(Namespace<T, C> &ns)
+    {
+      (ns.add_var(std::make_unique<Vs>()), ...);
+    }
+
+  private:
+    std::tuple<Vs...> _instances{};
+  };
+
+  //////////////////////////////////////////////////////////////////////////////
+
+  class StdInOutTransport : public BencodeTransport
+  {
+  public:
+    StdInOutTransport()
+    {
+      // every write is flushed already; tied, a read would flush `std::cout`
+      // first & wait behind a write the client does not read.
+      std::cin.tie(nullptr);
+    }
+
+  private:
+    std::mutex write_lock;
+
+    bc::data read() override
+    {
+      return bc::decode_some(std::cin, bc::no_check_eof);
+    }
+
+    bc::data read_raw(std::string &raw) override
+    {
+      return bencoded::decode_some(std::cin, raw);
+    }
+
+    void write(bc::data const &data) override
+    {
+      std::lock_guard<std::mutex> lock(write_lock);
+      bc::encode_to(std::cout, data);
+      std::cout << std::flush;
+    }
+
+    void write_encoded(std::string_view frame) override
     {
-      throw std::runtime_error{ "namespace not found: " + qualified_name };
+      std::lock_guard<std::mutex> lock(write_lock);
+      std::cout.write(frame.data(), static_cast<std::streamsize>(frame.size()));
+      std::cout << std::flush;
     }
-    std::unique_ptr<Namespace<T, C>> &ns = _ns[_ns_name];
 
-    auto _var_name = qualified_name.substr(pos + 1);
-    if(!ns->_vars.contains(_var_name))
+    bool writes_encoded() const override
     {
-      throw std::runtime_error{ "namespace var not found: " + qualified_name };
+      return true;
     }
-    return std::make_pair(ns.get(), ns->_vars[_var_name].get());
-  }
+  };
 
-  template <typename T, typename C>
-  inline bc::data Context<T, C>::describe(std::vector<std::unique_ptr<Namespace<T, C>>> &builtins)
+  /** Collects the responses of invokes run on behalf of another one (the
+   * builtin `invoke-many`): the invoke ids are `<parent id>/<index>`, their
+   * `out` & `err` go to the parent invoke. The responses are captured while
+   * the transport lives.
+   */
+  template <typename T>
+  class CaptureTransport : public BencodeTransport
   {
-    for(auto &ns : builtins)
+  public:
+    CaptureTransport(PodTransport<T> &parent, std::string const &parent_id, std::size_t n)
+      : _parent{ parent }
+      , _parent_id{ parent_id }
+      , _results(n)
+      , _chunks(n)
+      , _remaining{ n }
     {
-      add_ns(std::move(ns));
+      _parent.capture(_parent_id, this);
     }
 
-    bc::dict ops;
+    ~CaptureTransport()
     {
-      if(_cleanup)
-      {
-        ops = bc::dict{
-          { "shutdown", bc::dict{} }
-        };
-      }
+      _parent.uncapture(_parent_id);
     }
 
-    bc::list namespaces;
+    bc::data read() override
     {
-      if(!_pod_id.empty())
+      throw std::logic_error{ "capture transport is write only" };
+    }
+
+    void write(bc::data const &d) override
+    {
+      auto &m = std::get<bc::dict>(d);
+      if(auto out = m.find("out"); out != m.cend())
       {
-        if(_ns.contains(_pod_id))
+        _parent.send_stdout(_parent_id, std::get<bc::string>(out->second));
+        return;
+      }
+      if(auto err = m.find("err"); err != m.cend())
+      {
+        _parent.send_stderr(_parent_id, std::get<bc::string>(err->second));
+        return;
+      }
+      auto &id = std::get<bc::string>(m.at("id"));
+      std::size_t i{};
+      auto pos = id.rfind('/') + 1;
+      std::from_chars(id.data() + pos, id.data() + id.size(), i);
+
+      auto value = m.find("value");
+      auto done = false;
+      if(auto status = m.find("status"); status != m.cend())
+      {
+        for(auto &st : std::get<bc::list>(status->second))
+        {
+          done = done || std::get<bc::string>(st) == "done";
+        }
+      }
+      auto &encoder = *_parent._encoder;
+      std::lock_guard<std::mutex> lock(_lock);
+      if(i >= _results.size())
+      {
+        // after `wait`, the outcomes are gone.
+        return;
+      }
+      auto &r = _results[i];
+      if(auto ex = m.find("ex-message"); ex != m.cend())
+      {
+        r.ex_message = std::get<bc::string>(ex->second);
+        r.ex_data = encoder.decode(std::get<bc::string>(m.at("ex-data")));
+      }
+      else if(auto chunk = m.find("value-chunk"); chunk != m.cend())
+      {
+        _chunks.at(i) += std::get<bc::string>(chunk->second);
+      }
+      else if(value != m.cend())
+      {
+        auto v = encoder.decode(std::get<bc::string>(value->second));
+        if(done)
         {
-          std::unique_ptr<Namespace<T, C>> &ns = _ns[_pod_id];
-          namespaces.emplace_back(ns->describe());
+          r.value = std::move(v);
         }
         else
         {
-          namespaces.emplace_back(bc::dict{
-            { "name", _pod_id }
-          });
+          r.callbacks.push_back(std::move(v));
         }
       }
-      for(auto &n : _ns_names)
+      else if(done && !_chunks.at(i).empty())
       {
-        if(n == _pod_id)
-        {
-          continue;
-        }
-        std::unique_ptr<Namespace<T, C>> &ns = _ns[n];
-        namespaces.emplace_back(ns->describe());
+        // a streamed result, finished by a response without value.
+        r.value = encoder.decode(_chunks.at(i));
+        _chunks.at(i).clear();
+      }
+      if(done && --_remaining == 0)
+      {
+        _all_done.notify_all();
       }
     }
 
-    return bc::dict{
-      {     "format", this->format() },
-      {        "ops",            ops },
-      { "namespaces",     namespaces }
-    };
-  }
-
-  //////////////////////////////////////////////////////////////////////////////
-
-  class StdInOutTransport : public BencodeTransport
-  {
-    std::mutex write_lock;
-
-    bc::data read() override
+    /** Marks a call finished without running it. */
+    void fail(std::size_t i, std::string const &message)
     {
-      return bc::decode_some(std::cin, bc::no_check_eof);
+      std::lock_guard<std::mutex> lock(_lock);
+      _results.at(i).ex_message = message;
+      _results.at(i).ex_data = _parent._encoder->empty_dict();
+      if(--_remaining == 0)
+      {
+        _all_done.notify_all();
+      }
     }
 
-    void write(bc::data const &data) override
+    std::vector<InvokeResult<T>> wait()
     {
-      std::lock_guard<std::mutex> lock(write_lock);
-      bc::encode_to(std::cout, data);
-      std::cout << std::flush;
+      std::unique_lock<std::mutex> lock(_lock);
+      _all_done.wait(lock, [this] { return _remaining == 0; });
+      return std::move(_results);
     }
+
+  private:
+    PodTransport<T> &_parent;
+    std::string const _parent_id;
+    std::mutex _lock;
+    std::condition_variable _all_done;
+    std::vector<InvokeResult<T>> _results;
+    std::vector<std::string> _chunks;
+    std::size_t _remaining;
   };
 
+  /** Caps the number of invokes running at once. The limit is fixed, or,
+   * after `adapt`, adjusted from the observed invoke latency (the gradient
+   * algorithm of Netflix's concurrency-limits): while the recent latency stays
+   * within `tolerance` of its long term average the limit grows, when it rises
+   * (the vars or the host are saturated & work queues up) the limit shrinks.
+   *
+   * A free slot is taken with a CAS, only waiting goes through the mutex &
+   * condvar; waiters of a higher `priority` go first.
+   */
   class ConcurrencyLimiter
   {
   public:
     ConcurrencyLimiter(int max_concurrency)
-      : _max_concurrency{ max_concurrency }
+      : _limit{ max_concurrency }
+    {
+    }
+
+    /** Adapts the limit within [min_limit, max_limit], from the current one. */
+    void adapt(int min_limit, int max_limit)
     {
+      std::lock_guard<std::mutex> lock(_adapt_lock);
+      _min_limit = min_limit;
+      _max_limit = max_limit;
+      _estimate = std::clamp<double>(_limit.load(), min_limit, max_limit);
+      _limit.store(static_cast<int>(_estimate));
+      _adaptive.store(true);
     }
 
-    void acquire()
+    double tolerance{ 1.5 };
+    double smoothing{ 0.2 };
+
+    void acquire(int priority = 0)
     {
+      if(_waiting.load() == 0 && try_take())
+      {
+        return;
+      }
       std::unique_lock<std::mutex> lock(_mutex);
-      _condition.wait(lock, [this] { return _current_concurrency < _max_concurrency; });
-      _current_concurrency++;
+      _waiters[priority]++;
+      _waiting.fetch_add(1);
+      _condition.wait(lock,
+                      [this, priority] { return _waiters.cbegin()->first == priority && try_take(); });
+      _waiting.fetch_sub(1);
+      if(--_waiters[priority] == 0)
+      {
+        _waiters.erase(priority);
+      }
+      if(!_waiters.empty() && _inflight.load() < _limit.load())
+      {
+        _condition.notify_all();
+      }
     }
 
     void release()
     {
-      std::unique_lock<std::mutex> lock(_mutex);
-      _current_concurrency--;
-      _condition.notify_one();
+      _inflight.fetch_sub(1);
+      wake(false);
     }
 
+    /** Releases the slot of an invoke that ran for `latency`. */
+    void release(std::chrono::nanoseconds latency)
+    {
+      if(_adaptive.load())
+      {
+        sample(latency);
+      }
+      release();
+    }
+
+    int limit() const { return _limit.load(); }
+    int inflight() const { return _inflight.load(); }
+    int waiting() const { return _waiting.load(); }
+
   private:
-    int _max_concurrency;
-    int _current_concurrency{};
+    bool try_take()
+    {
+      auto n = _inflight.load();
+      while(n < _limit.load())
+      {
+        if(_inflight.compare_exchange_weak(n, n + 1))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void wake(bool all)
+    {
+      if(_waiting.load() == 0)
+      {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(_mutex);
+      // the one to wake is of the highest waiting priority.
+      if(all || _waiters.size() > 1)
+      {
+        _condition.notify_all();
+      }
+      else
+      {
+        _condition.notify_one();
+      }
+    }
+
+    void sample(std::chrono::nanoseconds latency)
+    {
+      // samples racing an update are dropped, they're plenty.
+      std::unique_lock<std::mutex> lock(_adapt_lock, std::try_to_lock);
+      if(!lock.owns_lock())
+      {
+        return;
+      }
+      auto ms = std::chrono::duration<double, std::milli>(latency).count();
+      if(_samples++ == 0)
+      {
+        _short_rtt = _long_rtt = ms;
+        return;
+      }
+      _short_rtt += (ms - _short_rtt) / 10;
+      _long_rtt += (ms - _long_rtt) / 600;
+      if(_long_rtt / _short_rtt > 2)
+      {
+        // recovering from a spike: let the long term average come down.
+        _long_rtt *= 0.95;
+      }
+      if(_inflight.load() < _estimate / 2)
+      {
+        // the limit is not what holds the invokes back, don't grow it.
+        return;
+      }
+      auto gradient = std::clamp(tolerance * _long_rtt / _short_rtt, 0.5, 1.0);
+      auto next = _estimate * gradient + std::sqrt(_estimate);
+      _estimate = std::clamp(_estimate * (1 - smoothing) + next * smoothing,
+                             static_cast<double>(_min_limit),
+                             static_cast<double>(_max_limit));
+      auto limit = static_cast<int>(_estimate);
+      if(limit > _limit.exchange(limit))
+      {
+        wake(true);
+      }
+    }
+
+    std::atomic_int _limit;
+    std::atomic_int _inflight{ 0 };
+    std::atomic_int _waiting{ 0 };
+    std::map<int, int, std::greater<int>> _waiters;
     std::mutex _mutex;
     std::condition_variable _condition;
+
+    std::atomic_bool _adaptive{ false };
+    std::mutex _adapt_lock;
+    int _min_limit{ 1 };
+    int _max_limit{ 1 };
+    double _estimate{ 1 };
+    double _short_rtt{ 0 };
+    double _long_rtt{ 0 };
+    long long _samples{ 0 };
   };
 
   // a default pod implementation.
@@ -760,8 +3081,24 @@ namespace lotuc::pod
   {
   public:
     ConcurrencyLimiter _concurrency_limiter;
+    usage::Ledger _usage;
+    /** Detached invokes waiting for their completion handle. */
+    std::atomic<long long> _detached{ 0 };
+    std::mutex _pendings_lock;
     std::map<std::string, PendingInvoke<T>> _pendings;
-    std::set<std::string> _builtin_ns_names{};
+    static constexpr char const *builtin_ns_name = "lotuc.babashka.pods";
+    std::set<std::string> _builtin_ns_names{ builtin_ns_name };
+
+    /** Graceful drain on `shutdown`: new invokes are rejected, the running
+     * ones get `drain_timeout` to finish; the ones still running after that
+     * get an error response, so every invoke is answered once (what they
+     * write later is dropped).
+     */
+    std::chrono::milliseconds drain_timeout{ 10000 };
+    std::atomic_bool _draining{ false };
+    std::mutex _inflight_lock;
+    std::condition_variable _inflight_cv;
+    std::multiset<std::string> _inflight{};
 
     class pendings_var : public Var<T, C>
     {
@@ -789,6 +3126,7 @@ namespace lotuc::pod
 
         void deref() override
         {
+          std::lock_guard<std::mutex> lock(pod._pendings_lock);
           std::vector<PendingInvoke<T> *> t;
           t.reserve(pod._pendings.size());
           for(auto &p : pod._pendings)
@@ -808,6 +3146,43 @@ namespace lotuc::pod
       }
     };
 
+    /** A builtin var implemented by a function of the derefer. */
+    class builtin_var : public Var<T, C>
+    {
+    public:
+      using fn = std::function<void(typename Var<T, C>::derefer &)>;
+      fn const f;
+
+      builtin_var(std::string const &name, std::string const &meta, fn f)
+        : Var<T, C>(name, meta, "", false)
+        , f{ std::move(f) }
+      {
+      }
+
+      class derefer : public Var<T, C>::derefer
+      {
+      public:
+        fn const &f;
+
+        derefer(Context<T, C> &ctx, std::string const &id, T const &args, fn const &f)
+          : Var<T, C>::derefer::derefer{ ctx, id, args }
+          , f{ f }
+        {
+        }
+
+        void deref() override
+        {
+          f(*this);
+        }
+      };
+
+      std::unique_ptr<typename Var<T, C>::derefer>
+      make_derefer(Context<T, C> &ctx, std::string const &id, T const &args) const override
+      {
+        return std::make_unique<derefer>(ctx, id, args, f);
+      }
+    };
+
     PodImpl(Context<T, C> &ctx)
       : PodImpl<T, C>::PodImpl{ ctx, 1024 }
     {
@@ -822,36 +3197,183 @@ namespace lotuc::pod
     std::vector<std::unique_ptr<Namespace<T, C>>> builtins() override
     {
       std::vector<std::unique_ptr<Namespace<T, C>>> ret;
-      auto ns = std::make_unique<Namespace<T, C>>("lotuc.babashka.pods");
-      _builtin_ns_names.insert(ns->name);
+      auto ns = std::make_unique<Namespace<T, C>>(builtin_ns_name);
       ns->add_var(std::make_unique<pendings_var>(*this));
+      ns->add_var(std::make_unique<builtin_var>(
+        "startup", "{:doc \"cold start metrics (ms)\"}", [](auto &d) {
+          d.ctx.send_invoke_success_bc(d.id, d.ctx._encoder->encode(d.ctx.startup_metrics()));
+          d.done = true;
+        }));
+      ns->add_var(std::make_unique<builtin_var>(
+        "invoke-many",
+        "{:doc \"(invoke-many [{:var v :args [...]} ...]), runs the calls in parallel, returns their outcomes in order\"}",
+        [this](auto &d) { invoke_many(d); }));
+      ns->add_var(std::make_unique<builtin_var>(
+        "concurrency", "{:doc \"concurrency limit & usage\"}", [this](auto &d) {
+          auto &l = _concurrency_limiter;
+          std::map<std::string, long long> r{ { "limit", l.limit() },
+                                              { "inflight", l.inflight() },
+                                              { "waiting", l.waiting() },
+                                              { "detached", _detached.load() },
+                                              { "abandoned", d.ctx.abandoned.load() } };
+          d.ctx.send_invoke_success_bc(d.id, d.ctx._encoder->encode(r));
+          d.done = true;
+        }));
+      ns->add_var(std::make_unique<builtin_var>(
+        "memory", "{:doc \"bytes held by in-flight invokes\"}", [](auto &d) {
+          d.ctx.send_invoke_success_bc(d.id, d.ctx._encoder->encode(d.ctx.memory.usage()));
+          d.done = true;
+        }));
+      ns->add_var(std::make_unique<builtin_var>(
+        "output", "{:doc \"output buffer metrics, time blocked on a slow client\"}", [](auto &d) {
+          d.ctx.send_invoke_success_bc(d.id, d.ctx._encoder->encode(d.ctx._transport->stats()));
+          d.done = true;
+        }));
+      ns->add_var(std::make_unique<builtin_var>(
+        "profile",
+        "{:doc \"(profile seconds [hz]), samples the pod's CPU time, returns the folded stacks\"}",
+        [](auto &d) {
+          auto args = d.ctx._encoder->numbers(d.args);
+          if(args.empty() || args.size() > 2)
+          {
+            throw std::invalid_argument{ "expects (profile seconds [hz])" };
+          }
+          // checked before the casts, NaN or huge numbers don't convert.
+          auto seconds = args[0];
+          auto hz = args.size() > 1 ? args[1] : 99;
+          if(!(seconds > 0 && seconds <= profile::Profiler::max_duration.count()))
+          {
+            throw std::invalid_argument{ "expects 0 < seconds <= 3600" };
+          }
+          if(!(hz >= 1 && hz <= profile::Profiler::max_hz))
+          {
+            throw std::invalid_argument{ "expects 1 <= hz <= 10000" };
+          }
+          auto duration = std::chrono::milliseconds{ static_cast<long long>(seconds * 1000) };
+          auto folded = profile::Profiler::instance().run(duration, static_cast<int>(hz));
+          d.ctx.send_invoke_success_bc(d.id, d.ctx._encoder->encode(folded));
+          d.done = true;
+        }));
+      ns->add_var(std::make_unique<builtin_var>(
+        "usage",
+        "{:doc \"resource usage totals per var & per caller tag (the tag invoke option)\"}",
+        [this](auto &d) {
+          d.ctx.send_invoke_success_bc(d.id, d.ctx._encoder->encode(_usage.totals()));
+          d.done = true;
+        }));
+      ns->add_var(std::make_unique<builtin_var>(
+        "trace-start", "{:doc \"start tracing invokes\"}", [](auto &d) {
+          trace::Tracer::instance().start();
+          d.success();
+        }));
+      ns->add_var(std::make_unique<builtin_var>(
+        "trace-stop", "{:doc \"stop tracing invokes\"}", [](auto &d) {
+          trace::Tracer::instance().stop();
+          d.success();
+        }));
+      ns->add_var(std::make_unique<builtin_var>(
+        "trace-dump", "{:doc \"recorded trace, in Chrome trace format\"}", [](auto &d) {
+          // the trace is JSON, it's sent as is.
+          d.ctx.send_invoke_success_bc(d.id, trace::Tracer::instance().dump());
+          d.done = true;
+        }));
       ret.push_back(std::move(ns));
       return ret;
     }
 
-    static void
-    do_invoke(Var<T, C> const *var, std::unique_ptr<typename Var<T, C>::derefer> derefer)
+    /** Threads running the calls of an `invoke-many`, each call also takes
+     * its slot of the concurrency limit.
+     */
+    std::size_t invoke_many_threads{ std::max(1u, std::thread::hardware_concurrency()) };
+
+    /** Runs the calls as invokes of the pod's context on a bounded pool of
+     * threads, captures their responses by id & sends all the outcomes as
+     * one value.
+     */
+    void invoke_many(typename Var<T, C>::derefer &d)
+    {
+      auto &ctx = this->ctx;
+      auto calls = ctx._encoder->invoke_calls(d.args);
+      // the derefers of detached calls keep the capture, it outlives what
+      // they write.
+      auto capture = std::make_shared<CaptureTransport<T>>(ctx, d.id, calls.size());
+      std::atomic<std::size_t> next{ 0 };
+      auto run = [&]() {
+        for(auto i = next.fetch_add(1); i < calls.size(); i = next.fetch_add(1))
+        {
+          std::unique_ptr<typename Var<T, C>::derefer> derefer;
+          std::pair<Namespace<T, C> const *, Var<T, C> const *> found{};
+          try
+          {
+            found = ctx.find_var(calls[i].var);
+            derefer = found.second->make_derefer(ctx, d.id + "/" + std::to_string(i), calls[i].args);
+          }
+          catch(std::exception const &e)
+          {
+            capture->fail(i, e.what());
+            continue;
+          }
+          derefer->keep_alive = capture;
+          // returns once the call is done, or detached.
+          PodImpl<T, C>::watched_invoke(this, found.first, found.second, std::move(derefer));
+        }
+      };
+      {
+        std::vector<std::thread> pool;
+        ScopeGuard _join{ [&pool]() {
+          for(auto &t : pool)
+          {
+            t.join();
+          }
+        } };
+        for(std::size_t t = 1; t < std::min(invoke_many_threads, calls.size()); t++)
+        {
+          pool.emplace_back(run);
+        }
+        run();
+      }
+      ctx.send_invoke_success_bc(d.id, ctx._encoder->encode(capture->wait()));
+      d.done = true;
+    }
+
+    static void do_invoke(Var<T, C> const *var, typename Var<T, C>::derefer *derefer)
     {
       try
       {
-        derefer->deref();
-        if(!derefer->done)
+        {
+          trace::Span span{ "deref", derefer->id };
+          derefer->deref();
+        }
+        if(!derefer->done && !derefer->detached())
         {
           derefer->error("illegal var implementation, deref returned without any notice");
         }
       }
       catch(ExInfo<T> const &e)
       {
-        derefer->error(e.message(), e.data());
+        fail(derefer, [&](auto &d) { d.error(e.message(), e.data()); });
       }
       catch(std::exception const &e)
       {
-        std::string ex_message = e.what();
-        derefer->error(ex_message);
+        fail(derefer, [&](auto &d) { d.error(e.what()); });
       }
       catch(...)
       {
-        derefer->error("unkown exception");
+        fail(derefer, [](auto &d) { d.error("unkown exception"); });
+      }
+    }
+
+    /** Errors a failed deref, through its completion handle once detached. */
+    template <typename F>
+    static void fail(typename Var<T, C>::derefer *derefer, F f)
+    {
+      if(!derefer->detached())
+      {
+        f(*derefer);
+      }
+      else if(auto c = derefer->completion(); c)
+      {
+        f(*c);
       }
     }
 
@@ -860,6 +3382,9 @@ namespace lotuc::pod
                                Var<T, C> const *var,
                                std::unique_ptr<typename Var<T, C>::derefer> derefer)
     {
+      std::string id = derefer->id;
+      auto started_us = trace::now_us();
+
       // Now we only got two logic "concurrency groups" here. The builtin one
       // and others. We only limit the concurrency runs for the non builtin
       // vars.
@@ -870,36 +3395,243 @@ namespace lotuc::pod
       auto is_builtin = pod->_builtin_ns_names.contains(ns->name);
       if(!is_builtin)
       {
-        pod->_concurrency_limiter.acquire();
-      }
-      ScopeGuard _release{ [pod, &is_builtin]() {
-        if(!is_builtin)
+        trace::Span span{ "queue", derefer->id };
+        try
         {
-          pod->_concurrency_limiter.release();
+          pod->ctx.await_ready();
         }
-      } };
+        catch(std::exception const &e)
+        {
+          derefer->error(std::string{ "components warm up failed: " } + e.what());
+          derefer.reset();
+          pod->finish_inflight(id);
+          return;
+        }
+        pod->_concurrency_limiter.acquire(derefer->priority);
+      }
 
       auto duration = std::chrono::system_clock::now().time_since_epoch();
       auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
-      std::string id = derefer->id;
-      T args = derefer->args;
 
-      auto fut = std::async(PodImpl<T, C>::do_invoke, var, std::move(derefer));
+      // the derefer lives until its pending entry is erased, which refers to
+      // its args.
+      std::unique_ptr<typename Var<T, C>::derefer> owned = std::move(derefer);
+      {
+        // the slot is held while `deref` runs.
+        ScopeGuard _release{ [pod, is_builtin, started = std::chrono::steady_clock::now()]() {
+          if(!is_builtin)
+          {
+            pod->_concurrency_limiter.release(std::chrono::steady_clock::now() - started);
+          }
+        } };
+        auto fut = std::async([pod, ns, var, d = owned.get()]() {
+          pin_current_thread(pod->affinity.workers);
+          profile::Running running{ ns->name, var->name, d->id };
+          profile::Scope _profiled{ running };
+          usage::Meter _metered{ d->usage };
+          PodImpl<T, C>::do_invoke(var, d);
+        });
+
+        // clang-format off
+        std::future<void> *pending_fut{};
+        {
+          std::lock_guard<std::mutex> lock(pod->_pendings_lock);
+          auto it = pod->_pendings.insert({ id, PendingInvoke<T>{ ns->name, var->name, id, &owned->args, millis, std::move(fut) } }).first;
+          pending_fut = &it->second.fut;
+        }
+        pending_fut->get();
+        // clang-format on
+      }
 
-      // clang-format off
-      ScopeGuard _cleanup{ [pod, &id]() { pod->_pendings.erase(id); } };
-      pod->_pendings.insert({ id, PendingInvoke<T>{ ns->name, var->name, id, args, millis, std::move(fut) } });
-      auto it = pod->_pendings.find(id);
-      if(it != pod->_pendings.end()) { it->second.fut.get(); }
-      // clang-format on
+      // the invoke is finished now, or when its completion handle is.
+      auto finish = [pod, ns, var, id, is_builtin, started_us](
+                      std::unique_ptr<typename Var<T, C>::derefer> d) {
+        if(!is_builtin)
+        {
+          auto &u = d->usage;
+          pod->_usage.add(ns->name + "/" + var->name, d->tag, u);
+          trace::complete(id, started_us, u.cpu_ns / 1000, u.bytes_in, u.bytes_out, u.allocations);
+        }
+        {
+          std::lock_guard<std::mutex> lock(pod->_pendings_lock);
+          pod->_pendings.erase(id);
+        }
+        d.reset();
+        // last: the pod may be gone once `drain` sees this invoke finished.
+        pod->finish_inflight(id);
+      };
+      if(auto c = owned->completion(); c)
+      {
+        pod->_detached.fetch_add(1);
+        auto adopted = c->adopt(owned, [pod, finish](auto d) {
+          pod->_detached.fetch_sub(1);
+          finish(std::move(d));
+        });
+        if(adopted)
+        {
+          return;
+        }
+        pod->_detached.fetch_sub(1);
+      }
+      finish(std::move(owned));
     }
 
     void invoke(Namespace<T, C> const &ns,
                 Var<T, C> const &var,
                 std::unique_ptr<typename Var<T, C>::derefer> derefer) override
     {
+      if(!enter_inflight(derefer->id))
+      {
+        derefer->error("pod is shutting down");
+        return;
+      }
       std::thread(PodImpl<T, C>::watched_invoke, this, &ns, &var, std::move(derefer)).detach();
     }
+
+    /** Invokes of the builtin namespaces are control work too. */
+    bool is_priority(bc::dict const &d) const override
+    {
+      if(Pod<T, C>::is_priority(d))
+      {
+        return true;
+      }
+      auto it = d.find("var");
+      auto var = it != d.cend() ? std::get_if<bc::string>(&it->second) : nullptr;
+      auto pos = var != nullptr ? var->find('/') : std::string::npos;
+      return pos != std::string::npos && _builtin_ns_names.contains(var->substr(0, pos));
+    }
+
+    /** Decodes the args on the invoke's own thread, so the read loop does
+     * not wait for big args to be decoded.
+     *
+     * The args are admitted into `ctx.memory` before the thread is spawned:
+     * once the budget is exceeded the user lane waits, the requests behind
+     * are not read ahead. While args are streamed, their chunks come through
+     * this lane, the invoke waits on its own thread instead.
+     */
+    void invoke_frame(Namespace<T, C> const &ns,
+                      Var<T, C> const &var,
+                      std::string const &id,
+                      bc::dict frame) override
+    {
+      if(!enter_inflight(id))
+      {
+        this->close_args_stream(id);
+        this->ctx.send_invoke_error(id, "pod is shutting down");
+        return;
+      }
+      std::size_t n{ 0 };
+      auto deferred = false;
+      if(budgeted(ns, var))
+      {
+        auto args = frame.find("args");
+        auto encoded = args != frame.cend() ? std::get_if<bc::string>(&args->second) : nullptr;
+        n = encoded != nullptr ? encoded->size() : 0;
+        if(frame.contains("args-stream"))
+        {
+          // bounded by the credit window, its own chunks (charged as they
+          // arrive) must not hold it back.
+          this->ctx.memory.charge(n);
+        }
+        else if(this->args_streaming())
+        {
+          deferred = true;
+        }
+        else if(!this->ctx.memory.admit(n))
+        {
+          this->ctx.send_invoke_error(id, "memory budget exceeded");
+          finish_inflight(id);
+          return;
+        }
+      }
+      std::thread([this, &ns, &var, id, n, deferred, frame = std::move(frame)]() {
+        // pinned before the args are decoded, their pages are first touched
+        // on the worker's node.
+        pin_current_thread(this->affinity.workers);
+        if(deferred && !this->ctx.memory.admit(n))
+        {
+          this->ctx.send_invoke_error(id, "memory budget exceeded");
+          finish_inflight(id);
+          return;
+        }
+        std::unique_ptr<typename Var<T, C>::derefer> derefer;
+        try
+        {
+          derefer = this->make_derefer(var, id, frame);
+          derefer->charged = n;
+        }
+        catch(std::exception const &e)
+        {
+          this->close_args_stream(id);
+          this->ctx.memory.release(n);
+          this->ctx.send_invoke_error(id, e.what());
+          finish_inflight(id);
+          return;
+        }
+        PodImpl<T, C>::watched_invoke(this, &ns, &var, std::move(derefer));
+      }).detach();
+    }
+
+    /** Whether the invoke's args & output count in `ctx.memory`. The builtin
+     * vars are not held back by the budget, except `invoke-many`: it runs
+     * user vars, within its own admission.
+     */
+    bool budgeted(Namespace<T, C> const &ns, Var<T, C> const &var) const
+    {
+      return !_builtin_ns_names.contains(ns.name)
+        || (ns.name == builtin_ns_name && var.name == "invoke-many");
+    }
+
+    /** Counts an invoke in flight, until its `finish_inflight`. Returns
+     * false once draining, the invoke is to be rejected.
+     */
+    bool enter_inflight(std::string const &id)
+    {
+      std::lock_guard<std::mutex> lock(_inflight_lock);
+      if(_draining.load())
+      {
+        return false;
+      }
+      _inflight.insert(id);
+      return true;
+    }
+
+    void finish_inflight(std::string const &id)
+    {
+      std::lock_guard<std::mutex> lock(_inflight_lock);
+      // one entry per invoke, a reused id has one entry per running invoke.
+      if(auto it = _inflight.find(id); it != _inflight.end())
+      {
+        _inflight.erase(it);
+      }
+      _inflight_cv.notify_all();
+    }
+
+    bool drain() override
+    {
+      std::unique_lock<std::mutex> lock(_inflight_lock);
+      _draining.store(true);
+      auto expired = false;
+      auto deadline = this->ctx.timers.after(drain_timeout, [this, &expired]() {
+        std::lock_guard<std::mutex> lock(_inflight_lock);
+        expired = true;
+        _inflight_cv.notify_all();
+      });
+      _inflight_cv.wait(lock, [this, &expired]() { return _inflight.empty() || expired; });
+      lock.unlock();
+      // once cancelled, the deadline is not running (nor `expired` used).
+      deadline.cancel();
+      lock.lock();
+      if(_inflight.empty())
+      {
+        return true;
+      }
+      for(auto &id : std::set<std::string>{ _inflight.begin(), _inflight.end() })
+      {
+        this->ctx.abandon(id, "pod shut down before the invoke finished");
+      }
+      return false;
+    }
   };
 };
 
@@ -907,6 +3639,10 @@ namespace lotuc::pod
   class _class_name : public lotuc::pod::Var<T, C>                                               \
   {                                                                                              \
   public:                                                                                        \
+    static constexpr std::string_view var_name = #_class_name;                                   \
+    static constexpr std::string_view var_meta = _meta;                                          \
+    static constexpr std::string_view var_code = _code;                                          \
+    static constexpr bool var_async = false;                                                     \
     _class_name()                                                                                \
       : lotuc::pod::Var<T, C>(#_class_name, _meta, _code, false)                                 \
     {                                                                                            \
@@ -923,6 +3659,10 @@ namespace lotuc::pod
   class _class_name : public lotuc::pod::Var<T, C>                                               \
   {                                                                                              \
   public:                                                                                        \
+    static constexpr std::string_view var_name = _name;                                          \
+    static constexpr std::string_view var_meta = _meta;                                          \
+    static constexpr std::string_view var_code = "";                                             \
+    static constexpr bool var_async = _async;                                                    \
     _class_name()                                                                                \
       : lotuc::pod::Var<T, C>(_name, _meta, "", _async)                                          \
     {                                                                                            \
@@ -0,0 +1,185 @@
+#ifndef POD_AFFINITY_H_
+#define POD_AFFINITY_H_
+
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// CPU placement of the pod's threads (Linux only, a no-op elsewhere).
+//
+// The read loop, the writer and the invoke workers can each be pinned to a set
+// of cores, given as a cpulist (`0-3,8`) or as a NUMA node (`node1`, its cores
+// are read from sysfs). There is no libnuma dependency: memory placement
+// follows the kernel's first-touch policy, the workers are pinned before they
+// decode the args & allocate their output buffers, so those pages land on the
+// worker's node.
+
+namespace lotuc::pod
+{
+#ifdef __linux__
+  inline constexpr int max_cpus = CPU_SETSIZE;
+#else
+  inline constexpr int max_cpus = 1024;
+#endif
+
+  struct Affinity
+  {
+    std::vector<int> reader;
+    std::vector<int> writer;
+    std::vector<int> workers;
+
+    bool empty() const { return reader.empty() && writer.empty() && workers.empty(); }
+
+    /** Parses `reader=0;writer=1;workers=node1` style specs. Placement is a
+     * tuning knob, a malformed item (or unknown role) is warned about on
+     * stderr & ignored, its threads are not pinned.
+     */
+    static Affinity parse(std::string_view spec)
+    {
+      Affinity a{};
+      while(!spec.empty())
+      {
+        auto end = spec.find(';');
+        auto item = spec.substr(0, end);
+        spec = end == std::string_view::npos ? std::string_view{} : spec.substr(end + 1);
+        if(item.empty())
+        {
+          continue;
+        }
+        try
+        {
+          a.set(item);
+        }
+        catch(std::invalid_argument const &e)
+        {
+          std::cerr << "affinity: ignoring " << item << ": " << e.what() << "\n";
+        }
+      }
+      return a;
+    }
+
+    /** `node<N>` or a cpulist, throws if malformed. */
+    static std::vector<int> parse_cpus(std::string_view s)
+    {
+      if(s.starts_with("node"))
+      {
+        auto path = "/sys/devices/system/node/" + std::string{ s } + "/cpulist";
+        std::ifstream in{ path };
+        std::string list;
+        if(!std::getline(in, list))
+        {
+          throw std::invalid_argument{ "unknown NUMA node: " + std::string{ s } };
+        }
+        return parse_cpulist(list);
+      }
+      return parse_cpulist(s);
+    }
+
+    /** Throws if malformed, or a cpu is not below `max_cpus`. */
+    static std::vector<int> parse_cpulist(std::string_view s)
+    {
+      auto to_int = [](std::string_view v) {
+        int n{};
+        auto [p, ec] = std::from_chars(v.data(), v.data() + v.size(), n);
+        if(ec != std::errc{} || p != v.data() + v.size() || v.empty())
+        {
+          throw std::invalid_argument{ "invalid cpu: " + std::string{ v } };
+        }
+        if(n < 0 || n >= max_cpus)
+        {
+          throw std::invalid_argument{ "cpu out of range: " + std::string{ v } };
+        }
+        return n;
+      };
+      std::vector<int> cpus;
+      while(!s.empty())
+      {
+        auto end = s.find(',');
+        auto range = s.substr(0, end);
+        s = end == std::string_view::npos ? std::string_view{} : s.substr(end + 1);
+        if(range.empty())
+        {
+          continue;
+        }
+        auto dash = range.find('-');
+        auto lo = to_int(range.substr(0, dash));
+        auto hi = dash == std::string_view::npos ? lo : to_int(range.substr(dash + 1));
+        if(hi < lo)
+        {
+          throw std::invalid_argument{ "invalid cpu range: " + std::string{ range } };
+        }
+        for(auto c = lo; c <= hi; c++)
+        {
+          cpus.push_back(c);
+        }
+      }
+      return cpus;
+    }
+
+  private:
+    void set(std::string_view item)
+    {
+      auto eq = item.find('=');
+      if(eq == std::string_view::npos)
+      {
+        throw std::invalid_argument{ "expecting role=cpus" };
+      }
+      auto role = item.substr(0, eq);
+      auto cpus = parse_cpus(item.substr(eq + 1));
+      if(role == "reader")
+      {
+        reader = std::move(cpus);
+      }
+      else if(role == "writer")
+      {
+        writer = std::move(cpus);
+      }
+      else if(role == "workers")
+      {
+        workers = std::move(cpus);
+      }
+      else
+      {
+        throw std::invalid_argument{ "unknown affinity role: " + std::string{ role } };
+      }
+    }
+  };
+
+  /** Pins the calling thread to `cpus`, returns false when it's not applied
+   * (empty set, unsupported platform or rejected by the kernel).
+   */
+  inline bool pin_current_thread(std::vector<int> const &cpus)
+  {
+#ifdef __linux__
+    if(cpus.empty())
+    {
+      return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(auto c : cpus)
+    {
+      if(c >= 0 && c < CPU_SETSIZE)
+      {
+        CPU_SET(c, &set);
+      }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+  }
+}
+
+#endif // POD_AFFINITY_H_
@@ -116,6 +116,12 @@ namespace lotuc::pod
       return v;
     }
 
+    bc::data read_raw(std::string &raw) override
+    {
+      _accept();
+      return bencoded::decode_some(_stream, raw);
+    }
+
     void write(bc::data const &data) override
     {
       _accept();
@@ -123,6 +129,25 @@ namespace lotuc::pod
       bc::encode_to(_stream, data);
       _stream.flush();
     }
+
+    void write_encoded(std::string_view frame) override
+    {
+      _accept();
+      std::lock_guard<std::mutex> lock(write_lock);
+      _stream.write(frame.data(), static_cast<std::streamsize>(frame.size()));
+      _stream.flush();
+    }
+
+    bool writes_encoded() const override
+    {
+      return true;
+    }
+
+    void close() override
+    {
+      asio::error_code ec;
+      _stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+    }
   };
 }
 
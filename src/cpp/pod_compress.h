@@ -0,0 +1,171 @@
+#ifndef POD_COMPRESS_H_
+#define POD_COMPRESS_H_
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef LOTUC_POD_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef LOTUC_POD_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// Payload compression codecs (optional).
+//
+// A codec is compiled in when its library is found: define
+// `LOTUC_POD_WITH_LZ4` (liblz4) or `LOTUC_POD_WITH_ZSTD` (libzstd) and link
+// it, the CMake build does it when pkg-config finds them. Without any, pods
+// advertise no codec and never compress.
+//
+// The codec is negotiated at `describe` & applied by `PodTransport` to the
+// payload strings (`value`, `value-chunk`, `args`, `chunk`) above a threshold,
+// the encoders never see compressed bytes. See `bench_compress` for the sizes
+// it pays off at.
+
+namespace lotuc::pod::compress
+{
+  /** Raw payloads above this are not inflated, a corrupt or hostile size must
+   * not allocate the memory.
+   */
+  inline constexpr std::size_t max_raw_size = std::size_t{ 1 } << 31;
+
+  class Codec
+  {
+  public:
+    virtual ~Codec() = default;
+
+    virtual std::string_view name() const = 0;
+
+    /** The packed bytes, empty if `raw` can't be packed by the codec. */
+    virtual std::string compress(std::string_view raw) const = 0;
+
+    /** Inflates `packed` into its `size` raw bytes, throws if it does not. */
+    virtual std::string decompress(std::string_view packed, std::size_t size) const = 0;
+  };
+
+#ifdef LOTUC_POD_WITH_LZ4
+  /** LZ4 block format: fast, a lower ratio. */
+  class Lz4 : public Codec
+  {
+  public:
+    std::string_view name() const override
+    {
+      return "lz4";
+    }
+
+    std::string compress(std::string_view raw) const override
+    {
+      if(raw.size() > LZ4_MAX_INPUT_SIZE)
+      {
+        return {};
+      }
+      std::string out(static_cast<std::size_t>(LZ4_compressBound(static_cast<int>(raw.size()))),
+                      '\0');
+      auto n = LZ4_compress_default(
+        raw.data(), out.data(), static_cast<int>(raw.size()), static_cast<int>(out.size()));
+      out.resize(n > 0 ? static_cast<std::size_t>(n) : 0);
+      return out;
+    }
+
+    std::string decompress(std::string_view packed, std::size_t size) const override
+    {
+      if(size > max_raw_size || size > LZ4_MAX_INPUT_SIZE)
+      {
+        throw std::runtime_error{ "lz4: raw size too large" };
+      }
+      std::string out(size, '\0');
+      auto n = LZ4_decompress_safe(
+        packed.data(), out.data(), static_cast<int>(packed.size()), static_cast<int>(size));
+      if(n < 0 || static_cast<std::size_t>(n) != size)
+      {
+        throw std::runtime_error{ "lz4: corrupt payload" };
+      }
+      return out;
+    }
+  };
+#endif
+
+#ifdef LOTUC_POD_WITH_ZSTD
+  /** Zstandard frames: a better ratio, slower. */
+  class Zstd : public Codec
+  {
+  public:
+    int level{ 1 };
+
+    std::string_view name() const override
+    {
+      return "zstd";
+    }
+
+    std::string compress(std::string_view raw) const override
+    {
+      // the contexts are reused, they are costly to make per payload.
+      thread_local std::unique_ptr<ZSTD_CCtx, Free> const cctx{ ZSTD_createCCtx() };
+      std::string out(ZSTD_compressBound(raw.size()), '\0');
+      auto n = ZSTD_compressCCtx(cctx.get(), out.data(), out.size(), raw.data(), raw.size(), level);
+      out.resize(ZSTD_isError(n) ? 0 : n);
+      return out;
+    }
+
+    std::string decompress(std::string_view packed, std::size_t size) const override
+    {
+      if(size > max_raw_size)
+      {
+        throw std::runtime_error{ "zstd: raw size too large" };
+      }
+      thread_local std::unique_ptr<ZSTD_DCtx, Free> const dctx{ ZSTD_createDCtx() };
+      std::string out(size, '\0');
+      auto n = ZSTD_decompressDCtx(dctx.get(), out.data(), size, packed.data(), packed.size());
+      if(ZSTD_isError(n) || n != size)
+      {
+        throw std::runtime_error{ "zstd: corrupt payload" };
+      }
+      return out;
+    }
+
+  private:
+    struct Free
+    {
+      void operator()(ZSTD_CCtx *c) const { ZSTD_freeCCtx(c); }
+      void operator()(ZSTD_DCtx *c) const { ZSTD_freeDCtx(c); }
+    };
+  };
+#endif
+
+  /** The compiled in codecs, the pod's preference first. */
+  inline std::vector<Codec const *> const &codecs()
+  {
+    static std::vector<Codec const *> const all = [] {
+      std::vector<Codec const *> v;
+#ifdef LOTUC_POD_WITH_LZ4
+      static Lz4 const lz4{};
+      v.push_back(&lz4);
+#endif
+#ifdef LOTUC_POD_WITH_ZSTD
+      static Zstd const zstd{};
+      v.push_back(&zstd);
+#endif
+      return v;
+    }();
+    return all;
+  }
+
+  inline Codec const *find(std::string_view name)
+  {
+    for(auto c : codecs())
+    {
+      if(c->name() == name)
+      {
+        return c;
+      }
+    }
+    return nullptr;
+  }
+}
+
+#endif // POD_COMPRESS_H_
@@ -4,6 +4,8 @@
 #include "pod.h"
 #include "pod_asio_transport.h"
 #include "pod_json_encoder.h"
+#include "pod_prefork.h"
+#include "pod_record.h"
 #include "jsonrpc.h"
 
 // JSON format, asio as tcp transport implementation.
@@ -50,7 +52,12 @@ namespace lotuc::pod
     std::unique_ptr<BencodeTransport> transport;
 
     std::function<void()> cleanup_transport = nullptr;
-    if(is_babashka_transport_socket())
+    if(is_prefork_worker())
+    {
+      encoder = std::make_unique<JsonEncoder>();
+      transport = std::make_unique<FdTransport>(std::stoi(getenv("POD_WORKER_FD")));
+    }
+    else if(is_babashka_transport_socket())
     {
       asio::io_context io_context;
       encoder = std::make_unique<JsonEncoder>();
@@ -63,6 +70,11 @@ namespace lotuc::pod
       transport = std::make_unique<StdInOutTransport>();
     }
 
+    if(auto path = getenv("POD_RECORD"); !path.empty() && !is_prefork_worker())
+    {
+      transport = std::make_unique<RecordingTransport>(std::move(transport), path);
+    }
+
     std::function<void()> cleanup_all{};
     if(cleanup || cleanup_transport)
     {
@@ -49,6 +49,15 @@ namespace lotuc::pod
       return json(status).dump();
     }
 
+    static json args_of(PendingInvoke<json> const &p)
+    {
+      if(p.args != nullptr)
+      {
+        return *p.args;
+      }
+      return p.encoded_args.empty() ? json::array() : json::parse(p.encoded_args);
+    }
+
     std::string encode(std::vector<PendingInvoke<json> *> const &pendings) override
     {
       json r;
@@ -58,13 +67,122 @@ namespace lotuc::pod
           {       "id",       p->id },
           {  "ns-name",  p->ns_name },
           { "var-name", p->var_name },
-          {     "args",     p->args },
+          {     "args",    args_of(*p) },
           { "start-ts", p->start_ts }
         });
       }
       return r.dump();
     }
 
+    std::string encode(std::map<std::string, long long> const &metrics) override
+    {
+      return json(metrics).dump();
+    }
+
+    std::string
+    encode(std::map<std::string, std::map<std::string, long long>> const &groups) override
+    {
+      return json(groups).dump();
+    }
+
+    std::string encode_list(std::vector<json> const &vs) override
+    {
+      std::string r{ "[" };
+      for(auto &v : vs)
+      {
+        if(r.size() > 1)
+        {
+          r += ',';
+        }
+        r += v.dump();
+      }
+      r += ']';
+      return r;
+    }
+
+    /** The args are `[[{"var": ..., "args": [...]}, ...]]`. */
+    std::vector<InvokeCall<json>> invoke_calls(json const &v) override
+    {
+      if(!v.is_array() || v.size() != 1 || !v[0].is_array())
+      {
+        throw std::invalid_argument{ "expects one argument, the list of calls" };
+      }
+      std::vector<InvokeCall<json>> calls;
+      calls.reserve(v[0].size());
+      for(auto &c : v[0])
+      {
+        calls.push_back({ c.at("var").get<std::string>(), c.value("args", json::array()) });
+      }
+      return calls;
+    }
+
+    std::vector<double> numbers(json const &args) override
+    {
+      std::vector<double> ret;
+      for(auto &a : args)
+      {
+        if(!a.is_number())
+        {
+          throw std::invalid_argument{ "expects numbers, got: " + a.dump() };
+        }
+        ret.push_back(a.get<double>());
+      }
+      return ret;
+    }
+
+    std::string encode(std::vector<InvokeResult<json>> const &results) override
+    {
+      json r = json::array();
+      for(auto &x : results)
+      {
+        json e = json::object();
+        if(x.ex_message.has_value())
+        {
+          e["ex-message"] = x.ex_message.value();
+          e["ex-data"] = x.ex_data.value_or(json::object());
+        }
+        else
+        {
+          e["value"] = x.value.value_or(nullptr);
+        }
+        if(!x.callbacks.empty())
+        {
+          e["callbacks"] = x.callbacks;
+        }
+        r.push_back(std::move(e));
+      }
+      return r.dump();
+    }
+
+    /** Handles are objects of `shm/path`, `shm/offset`, `shm/length`. */
+    std::optional<ShmHandle> shm_handle(json const &v) override
+    {
+      if(!v.is_object() || !v.contains("shm/path"))
+      {
+        return std::nullopt;
+      }
+      auto &path = v.at("shm/path");
+      auto offset = v.find("shm/offset");
+      auto length = v.find("shm/length");
+      if(!path.is_string() || (offset != v.end() && !offset->is_number_unsigned())
+         || length == v.end() || !length->is_number_unsigned())
+      {
+        throw std::invalid_argument{ "malformed shm handle" };
+      }
+      return ShmHandle{ path.get<std::string>(),
+                        offset != v.end() ? offset->get<std::size_t>() : 0,
+                        length->get<std::size_t>() };
+    }
+
+    json make_shm_handle(ShmHandle const &h) override
+    {
+      return {
+        {   "shm/path",   h.path },
+        { "shm/offset", h.offset },
+        { "shm/length", h.length }
+      };
+    }
+
     json decode(std::string const &s) override
     {
       return json::parse(s);
@@ -0,0 +1,379 @@
+#ifndef POD_OUTPUT_H_
+#define POD_OUTPUT_H_
+
+#include "pod.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Slow consumer protection.
+//
+// Without it, invokes write their responses straight to the transport, and a
+// client that stops reading blocks every invoke thread behind the transport's
+// write lock. `BufferedTransport` puts a bounded buffer in front of the
+// transport, a writer thread of its own is the only one writing to it. When
+// the buffer is full, the `Policy` decides for the producing invoke only.
+
+namespace lotuc::pod
+{
+  class BufferedTransport : public BencodeTransport
+  {
+  public:
+    /** What happens to a frame that does not fit in the buffer:
+     *
+     * - `block`: the producer waits for room.
+     * - `drop_callbacks`: callback frames are dropped, the others wait.
+     * - `coalesce_callbacks`: a callback replaces the invoke's callback still
+     *   in the buffer (intermediate values are lost), the others wait.
+     * - `fail`: callback, chunk & success frames throw, failing their invoke;
+     *   error frames wait.
+     *
+     * Callbacks are the `value` frames of an empty `status`. The pieces of a
+     * chunked result (`value-chunk`) are never dropped nor coalesced.
+     */
+    enum class Policy
+    {
+      block,
+      drop_callbacks,
+      coalesce_callbacks,
+      fail
+    };
+
+    BufferedTransport(std::unique_ptr<BencodeTransport> transport,
+                      std::size_t capacity,
+                      Policy policy = Policy::block)
+      : _s{ std::make_shared<state>(std::move(transport), capacity, policy) }
+      , _writer{ &BufferedTransport::write_loop, _s }
+    {
+    }
+
+    /** Writes the buffered frames out for up to `close_timeout`, then gives
+     * up on the client (see `close`). A writer still blocked in the transport
+     * (one that can't be closed) is left behind.
+     */
+    ~BufferedTransport() override
+    {
+      std::unique_lock<std::mutex> lock(_s->lock);
+      _s->stopping = true;
+      _s->work.notify_all();
+      auto stopped = [this] { return _s->stopped; };
+      if(!_s->drained.wait_for(lock, close_timeout, stopped))
+      {
+        _s->break_off();
+        lock.unlock();
+        _s->transport->close();
+        lock.lock();
+        if(!_s->drained.wait_for(lock, close_timeout, stopped))
+        {
+          // it holds the state, & the transport, until its write returns.
+          _writer.detach();
+          return;
+        }
+      }
+      lock.unlock();
+      _writer.join();
+    }
+
+    /** How long `flush` & the destructor wait for the buffered frames to be
+     * written: a client that stopped reading would hang them.
+     */
+    std::chrono::milliseconds close_timeout{ 1000 };
+
+    bc::data read() override
+    {
+      return _s->transport->read();
+    }
+
+    void write(bc::data const &d) override
+    {
+      auto kind = kind_of(d);
+      std::string id{};
+      if(kind == frame_kind::callback)
+      {
+        id = std::get<bc::string>(std::get<bc::dict>(d).at("id"));
+      }
+      enqueue(bc::encode(d), kind, std::move(id));
+    }
+
+    void write_encoded(std::string_view frame) override
+    {
+      enqueue(std::string{ frame }, frame_kind::other, {});
+    }
+
+    bool writes_encoded() const override
+    {
+      return true;
+    }
+
+    /** Waits for the buffered frames to be written, up to `close_timeout`,
+     * then gives up on the client.
+     */
+    void flush() override
+    {
+      auto written = false;
+      {
+        std::unique_lock<std::mutex> lock(_s->lock);
+        written = _s->drained.wait_for(lock, close_timeout, [this] {
+          return (_s->queue.empty() && !_s->writing) || _s->broken;
+        });
+      }
+      if(!written)
+      {
+        close();
+        return;
+      }
+      _s->transport->flush();
+    }
+
+    /** Gives up on the client: the frames left are dropped & the transport
+     * is closed.
+     */
+    void close() override
+    {
+      {
+        std::lock_guard<std::mutex> lock(_s->lock);
+        _s->break_off();
+      }
+      _s->transport->close();
+    }
+
+    bool closed() const override
+    {
+      std::lock_guard<std::mutex> lock(_s->lock);
+      return _s->broken;
+    }
+
+    /** Pins the writer thread (see `pod_affinity.h`). */
+    void pin_writer(std::vector<int> cpus)
+    {
+      std::lock_guard<std::mutex> lock(_s->lock);
+      _s->pin = std::move(cpus);
+      _s->work.notify_all();
+    }
+
+    std::map<std::string, long long> stats() override
+    {
+      auto &s = *_s;
+      std::lock_guard<std::mutex> lock(s.lock);
+      return { { "blocked-ms", static_cast<long long>(s.blocked.count() / 1000000) },
+               { "blocked-count", s.blocked_count },
+               { "dropped", s.dropped },
+               { "coalesced", s.coalesced },
+               { "failed", s.failed },
+               { "queued-bytes", static_cast<long long>(s.queued_bytes) },
+               { "peak-queued-bytes", static_cast<long long>(s.peak_bytes) },
+               { "capacity", static_cast<long long>(s.capacity) } };
+    }
+
+  private:
+    enum class frame_kind
+    {
+      callback,
+      chunk,
+      success,
+      error,
+      other
+    };
+
+    struct entry
+    {
+      std::string bytes;
+      frame_kind kind;
+      std::string id;
+    };
+
+    /** Shared with the writer thread, which may outlive the transport. */
+    struct state
+    {
+      state(std::unique_ptr<BencodeTransport> transport, std::size_t capacity, Policy policy)
+        : transport{ std::move(transport) }
+        , capacity{ capacity }
+        , policy{ policy }
+      {
+      }
+
+      std::unique_ptr<BencodeTransport> transport;
+      std::size_t const capacity;
+      Policy const policy;
+
+      std::mutex lock;
+      std::condition_variable work;
+      std::condition_variable room;
+      std::condition_variable drained;
+      std::deque<entry> queue;
+      std::size_t queued_bytes{ 0 };
+      std::size_t peak_bytes{ 0 };
+      bool writing{ false };
+      bool stopping{ false };
+      bool stopped{ false };
+      bool broken{ false };
+      std::vector<int> pin{};
+
+      std::chrono::nanoseconds blocked{ 0 };
+      long long blocked_count{ 0 };
+      long long dropped{ 0 };
+      long long coalesced{ 0 };
+      long long failed{ 0 };
+
+      /** Marks the client gone, with `lock` held. */
+      void break_off()
+      {
+        broken = true;
+        queued_bytes = 0;
+        queue.clear();
+        room.notify_all();
+        drained.notify_all();
+      }
+    };
+
+    static frame_kind kind_of(bc::data const &d)
+    {
+      auto m = std::get_if<bc::dict>(&d);
+      if(m == nullptr)
+      {
+        return frame_kind::other;
+      }
+      auto status = m->find("status");
+      if(status == m->cend())
+      {
+        return frame_kind::other;
+      }
+      auto &l = std::get<bc::list>(status->second);
+      for(auto &s : l)
+      {
+        if(std::get<bc::string>(s) == "error")
+        {
+          return frame_kind::error;
+        }
+      }
+      if(!l.empty())
+      {
+        return frame_kind::success;
+      }
+      if(m->contains("value-chunk"))
+      {
+        return frame_kind::chunk;
+      }
+      return m->contains("value") ? frame_kind::callback : frame_kind::other;
+    }
+
+    void enqueue(std::string bytes, frame_kind kind, std::string id)
+    {
+      auto &s = *_s;
+      std::unique_lock<std::mutex> lock(s.lock);
+      if(s.broken)
+      {
+        // the client is gone.
+        return;
+      }
+      auto fits = [&s, &bytes] {
+        return s.broken || s.queued_bytes == 0 || s.queued_bytes + bytes.size() <= s.capacity;
+      };
+      if(!fits())
+      {
+        if(kind == frame_kind::callback && s.policy == Policy::drop_callbacks)
+        {
+          s.dropped++;
+          return;
+        }
+        if(kind == frame_kind::callback && s.policy == Policy::coalesce_callbacks)
+        {
+          for(auto it = s.queue.rbegin(); it != s.queue.rend(); it++)
+          {
+            if(it->kind == frame_kind::callback && it->id == id)
+            {
+              s.queued_bytes = s.queued_bytes - it->bytes.size() + bytes.size();
+              it->bytes = std::move(bytes);
+              s.coalesced++;
+              return;
+            }
+          }
+        }
+        if(s.policy == Policy::fail && kind != frame_kind::error && kind != frame_kind::other)
+        {
+          s.failed++;
+          throw std::runtime_error{ "output buffer full, the client is not reading" };
+        }
+        auto start = std::chrono::steady_clock::now();
+        s.room.wait(lock, fits);
+        s.blocked += std::chrono::steady_clock::now() - start;
+        s.blocked_count++;
+        if(s.broken)
+        {
+          return;
+        }
+      }
+      s.queued_bytes += bytes.size();
+      s.peak_bytes = std::max(s.peak_bytes, s.queued_bytes);
+      s.queue.push_back({ std::move(bytes), kind, std::move(id) });
+      s.work.notify_one();
+    }
+
+    static void write_loop(std::shared_ptr<state> s)
+    {
+      while(true)
+      {
+        std::deque<entry> batch;
+        std::vector<int> pin;
+        {
+          std::unique_lock<std::mutex> lock(s->lock);
+          s->work.wait(lock, [&s] { return !s->queue.empty() || !s->pin.empty() || s->stopping; });
+          pin.swap(s->pin);
+          if(s->queue.empty() && s->stopping)
+          {
+            s->stopped = true;
+            s->drained.notify_all();
+            return;
+          }
+          batch.swap(s->queue);
+          s->writing = !batch.empty();
+        }
+        pin_current_thread(pin);
+        for(auto &e : batch)
+        {
+          {
+            std::lock_guard<std::mutex> lock(s->lock);
+            if(s->broken)
+            {
+              break;
+            }
+          }
+          try
+          {
+            s->transport->write_encoded(e.bytes);
+          }
+          catch(std::exception const &)
+          {
+            std::lock_guard<std::mutex> lock(s->lock);
+            s->break_off();
+            break;
+          }
+          std::lock_guard<std::mutex> lock(s->lock);
+          s->queued_bytes -= std::min(s->queued_bytes, e.bytes.size());
+          s->room.notify_all();
+        }
+        std::lock_guard<std::mutex> lock(s->lock);
+        s->writing = false;
+        if(s->queue.empty())
+        {
+          s->drained.notify_all();
+        }
+      }
+    }
+
+    std::shared_ptr<state> _s;
+    std::thread _writer;
+  };
+}
+
+#endif // POD_OUTPUT_H_
@@ -0,0 +1,593 @@
+#ifndef POD_PREFORK_H_
+#define POD_PREFORK_H_
+
+#include "pod.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern char **environ;
+
+// Prefork mode (POSIX only): the process babashka launches is a front end
+// speaking the pod protocol, the invokes run in N worker processes.
+//
+// Workers are the same executable re-executed with `POD_WORKER_FD` set to
+// their end of a socketpair, over which they run as a regular pod (see
+// `build_json_ctx`). The front end answers `describe`, `load-ns` & the
+// builtin vars itself (`pendings` lists the invokes of all the workers),
+// routes the other invokes to a worker & relays its responses. A worker that
+// dies is restarted, its unfinished invokes get an error response.
+// `shutdown` drains the front end, then shuts the workers down.
+
+namespace lotuc::pod
+{
+  /** Whether this process is a prefork worker. */
+  inline bool is_prefork_worker()
+  {
+    return !getenv("POD_WORKER_FD").empty();
+  }
+
+  /** Bencode frames over a socket (or pipe) file descriptor, owns it. */
+  class FdTransport : public BencodeTransport
+  {
+  public:
+    explicit FdTransport(int fd)
+      : _fd{ fd }
+      , _buf{ fd }
+      , _in{ &_buf }
+    {
+    }
+
+    ~FdTransport() override
+    {
+      ::close(_fd);
+    }
+
+    bc::data read() override
+    {
+      return bc::decode_some(_in, bc::no_check_eof);
+    }
+
+    void write(bc::data const &d) override
+    {
+      write_encoded(bc::encode(d));
+    }
+
+    void write_encoded(std::string_view frame) override
+    {
+      std::lock_guard<std::mutex> lock(_write_lock);
+      while(!frame.empty())
+      {
+        auto n = ::send(_fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        if(n <= 0)
+        {
+          throw std::runtime_error{ std::string{ "fd write: " } + std::strerror(errno) };
+        }
+        frame.remove_prefix(static_cast<std::size_t>(n));
+      }
+    }
+
+    bool writes_encoded() const override
+    {
+      return true;
+    }
+
+    /** Stops the writes (& the peer's reads) without closing the fd. */
+    void shutdown_write()
+    {
+      ::shutdown(_fd, SHUT_WR);
+    }
+
+    void close() override
+    {
+      ::shutdown(_fd, SHUT_RDWR);
+    }
+
+  private:
+    class FdBuf : public std::streambuf
+    {
+    public:
+      explicit FdBuf(int fd)
+        : _fd{ fd }
+      {
+      }
+
+    protected:
+      int_type underflow() override
+      {
+        ssize_t n;
+        do
+        {
+          n = ::read(_fd, _buf, sizeof(_buf));
+        } while(n < 0 && errno == EINTR);
+        if(n <= 0)
+        {
+          return traits_type::eof();
+        }
+        setg(_buf, _buf, _buf + n);
+        return traits_type::to_int_type(*gptr());
+      }
+
+    private:
+      int _fd;
+      char _buf[1 << 16];
+    };
+
+    int _fd;
+    FdBuf _buf;
+    std::istream _in;
+    std::mutex _write_lock;
+  };
+
+  template <typename T, typename C>
+  class PreforkPod : public PodImpl<T, C>
+  {
+  public:
+    /** Which worker runs an invoke: in turn, or by hash of the var (or var &
+     * args, so equal calls land on the same worker & its caches).
+     */
+    enum class Routing
+    {
+      round_robin,
+      by_var,
+      by_args
+    };
+
+    /** Starts the workers, `argv` is the command line they are executed with
+     * (the executable itself is `/proc/self/exe` when available, or
+     * `argv[0]`).
+     */
+    PreforkPod(Context<T, C> &ctx,
+               std::size_t workers,
+               std::vector<std::string> argv,
+               Routing routing = Routing::round_robin)
+      : PodImpl<T, C>{ ctx }
+      , _argv{ std::move(argv) }
+      , _routing{ routing }
+      , _workers(workers)
+    {
+      if(workers == 0)
+      {
+        throw std::invalid_argument{ "prefork needs at least one worker" };
+      }
+      std::error_code ec;
+      _exe = std::filesystem::exists("/proc/self/exe", ec) ? "/proc/self/exe" : _argv.at(0);
+      try
+      {
+        for(std::size_t i = 0; i < workers; i++)
+        {
+          _workers[i] = std::make_unique<worker>();
+          auto t = spawn(i);
+          std::lock_guard<std::mutex> lock(_readers_lock);
+          _readers++;
+          _relays.emplace_back(&PreforkPod::relay, this, i, std::move(t));
+        }
+      }
+      catch(...)
+      {
+        stop();
+        throw;
+      }
+    }
+
+    /** Stops the workers (unless `drain` did) & joins their relays. */
+    ~PreforkPod()
+    {
+      stop();
+    }
+
+    PreforkPod(PreforkPod const &) = delete;
+    PreforkPod &operator=(PreforkPod const &) = delete;
+
+    void invoke_frame(Namespace<T, C> const &ns,
+                      Var<T, C> const &var,
+                      std::string const &id,
+                      bc::dict frame) override
+    {
+      if(this->_builtin_ns_names.contains(ns.name))
+      {
+        PodImpl<T, C>::invoke_frame(ns, var, id, std::move(frame));
+        return;
+      }
+      if(frame.contains("args-stream"))
+      {
+        // the chunks are dispatched here, they are not routed to the workers.
+        this->close_args_stream(id);
+        this->ctx.send_invoke_error(id, "streamed args are not supported by prefork workers");
+        return;
+      }
+      auto args = frame.find("args");
+      auto encoded_args = args != frame.cend() ? std::get<bc::string>(args->second) : "";
+      auto &w = *_workers[route(ns.name + "/" + var.name, encoded_args)];
+
+      if(!this->enter_inflight(id))
+      {
+        this->ctx.send_invoke_error(id, "pod is shutting down");
+        return;
+      }
+      // the args are held until the worker is done, see `complete`.
+      if(!this->ctx.memory.admit(encoded_args.size()))
+      {
+        this->ctx.send_invoke_error(id, "memory budget exceeded");
+        this->finish_inflight(id);
+        return;
+      }
+      auto duration = std::chrono::system_clock::now().time_since_epoch();
+      auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+      {
+        std::lock_guard<std::mutex> lock(this->_pendings_lock);
+        PendingInvoke<T> p{ ns.name, var.name, id, nullptr, millis, std::future<void>{} };
+        p.encoded_args = std::move(encoded_args);
+        this->_pendings.insert({ id, std::move(p) });
+      }
+      try
+      {
+        std::lock_guard<std::mutex> lock(w.lock);
+        w.outstanding.insert(id);
+        w.transport->write(frame);
+      }
+      catch(std::exception const &e)
+      {
+        {
+          std::lock_guard<std::mutex> lock(w.lock);
+          if(auto it = w.outstanding.find(id); it != w.outstanding.end())
+          {
+            w.outstanding.erase(it);
+          }
+        }
+        this->ctx.send_invoke_error(id, std::string{ "worker unavailable: " } + e.what());
+        complete(id);
+      }
+    }
+
+    /** Drains the front end, then shuts the workers down. */
+    bool drain() override
+    {
+      auto drained = PodImpl<T, C>::drain();
+      _stopping.store(true);
+      for(auto &w : _workers)
+      {
+        std::lock_guard<std::mutex> lock(w->lock);
+        if(!drained)
+        {
+          // answered by the drain, the workers' replies are dropped.
+          w->outstanding.clear();
+        }
+        try
+        {
+          w->transport->write(bc::dict{ { "op", "shutdown" } });
+        }
+        catch(std::exception const &)
+        {
+        }
+      }
+      std::unique_lock<std::mutex> lock(_readers_lock);
+      if(!_readers_cv.wait_for(lock, this->drain_timeout, [this] { return _readers == 0; }))
+      {
+        lock.unlock();
+        stop_workers(SIGKILL);
+        lock.lock();
+        _readers_cv.wait(lock, [this] { return _readers == 0; });
+      }
+      return drained;
+    }
+
+  private:
+    struct worker
+    {
+      std::mutex lock;
+      /** -1 once reaped, the pid may be reused. */
+      pid_t pid{ -1 };
+      std::chrono::steady_clock::time_point started{};
+      std::shared_ptr<FdTransport> transport;
+      /** The invokes the worker is to answer, a reused id once per invoke. */
+      std::multiset<std::string> outstanding;
+    };
+
+    std::size_t route(std::string const &var, std::string const &args)
+    {
+      auto n = _workers.size();
+      switch(_routing)
+      {
+      case Routing::by_var:
+        return std::hash<std::string>{}(var) % n;
+      case Routing::by_args:
+        return (std::hash<std::string>{}(var) ^ (std::hash<std::string>{}(args) << 1)) % n;
+      default:
+        return _next.fetch_add(1) % n;
+      }
+    }
+
+    /** Starts worker `i`, returns its transport. */
+    std::shared_ptr<FdTransport> spawn(std::size_t i)
+    {
+      int sv[2];
+      // close-on-exec from the start, no other fork may inherit them.
+      if(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0)
+      {
+        throw std::runtime_error{ std::string{ "socketpair: " } + std::strerror(errno) };
+      }
+
+      // everything the child needs is prepared before the fork, between fork
+      // & exec it only makes async-signal-safe calls.
+      std::vector<char *> argv;
+      for(auto &a : _argv)
+      {
+        argv.push_back(const_cast<char *>(a.c_str()));
+      }
+      argv.push_back(nullptr);
+      auto fd_env = "POD_WORKER_FD=" + std::to_string(sv[1]);
+      std::vector<char *> envp;
+      for(char **e = environ; *e != nullptr; e++)
+      {
+        if(std::strncmp(*e, "POD_WORKER_FD=", 14) != 0)
+        {
+          envp.push_back(*e);
+        }
+      }
+      envp.push_back(fd_env.data());
+      envp.push_back(nullptr);
+
+      auto pid = ::fork();
+      if(pid == 0)
+      {
+        ::fcntl(sv[1], F_SETFD, 0);
+        // stdin & stdout belong to the front end's client.
+        int null = ::open("/dev/null", O_RDONLY);
+        ::dup2(null, 0);
+        ::dup2(2, 1);
+        ::execve(_exe.c_str(), argv.data(), envp.data());
+        ::_exit(127);
+      }
+      ::close(sv[1]);
+      if(pid < 0)
+      {
+        ::close(sv[0]);
+        throw std::runtime_error{ std::string{ "fork: " } + std::strerror(errno) };
+      }
+
+      auto t = std::make_shared<FdTransport>(sv[0]);
+      auto &w = *_workers[i];
+      {
+        std::lock_guard<std::mutex> lock(w.lock);
+        w.pid = pid;
+        w.started = std::chrono::steady_clock::now();
+        w.transport = t;
+      }
+      return t;
+    }
+
+    void stop()
+    {
+      _stopping.store(true);
+      std::unique_lock<std::mutex> lock(_readers_lock);
+      while(_readers != 0)
+      {
+        // a relay restarting its worker as the pod stops starts it once more.
+        lock.unlock();
+        stop_workers(SIGTERM);
+        lock.lock();
+        _readers_cv.wait_for(lock, std::chrono::milliseconds{ 100 }, [this] {
+          return _readers == 0;
+        });
+      }
+      lock.unlock();
+      for(auto &t : _relays)
+      {
+        t.join();
+      }
+    }
+
+    /** Closes the workers' transports & signals them. */
+    void stop_workers(int sig)
+    {
+      for(auto &w : _workers)
+      {
+        if(w == nullptr)
+        {
+          // the constructor failed before it.
+          continue;
+        }
+        std::lock_guard<std::mutex> lock(w->lock);
+        if(w->transport)
+        {
+          w->transport->close();
+        }
+        if(w->pid > 0)
+        {
+          ::kill(w->pid, sig);
+        }
+      }
+    }
+
+    /** Relays the responses of worker `i`, restarts it when it's gone. */
+    void relay(std::size_t i, std::shared_ptr<FdTransport> t)
+    {
+      while(t != nullptr)
+      {
+        relay_frames(i, *t);
+        t = restart(i, t);
+      }
+      std::lock_guard<std::mutex> lock(_readers_lock);
+      _readers--;
+      _readers_cv.notify_all();
+    }
+
+    /** Until the worker is gone, or sends a malformed frame (it's then
+     * killed & handled as failed).
+     */
+    void relay_frames(std::size_t i, FdTransport &t)
+    {
+      auto malformed = [this, i](char const *what) {
+        std::cerr << "prefork: worker " << i << " sent a malformed frame: " << what << "\n";
+        std::lock_guard<std::mutex> lock(_workers[i]->lock);
+        ::kill(_workers[i]->pid, SIGKILL);
+      };
+      while(true)
+      {
+        bc::data v;
+        try
+        {
+          v = t.read();
+        }
+        catch(std::exception const &)
+        {
+          break;
+        }
+        auto m = std::get_if<bc::dict>(&v);
+        if(m == nullptr)
+        {
+          continue;
+        }
+        auto done = false;
+        if(auto status = m->find("status"); status != m->cend())
+        {
+          auto sts = std::get_if<bc::list>(&status->second);
+          if(sts == nullptr)
+          {
+            malformed("status is not a list");
+            return;
+          }
+          for(auto &st : *sts)
+          {
+            auto s = std::get_if<bc::string>(&st);
+            if(s == nullptr)
+            {
+              malformed("status is not a list of strings");
+              return;
+            }
+            done = done || *s == "done";
+          }
+        }
+        auto it = m->find("id");
+        auto id = it != m->cend() ? std::get_if<bc::string>(&it->second) : nullptr;
+        if(id == nullptr)
+        {
+          continue;
+        }
+        {
+          std::lock_guard<std::mutex> lock(_workers[i]->lock);
+          auto &outstanding = _workers[i]->outstanding;
+          auto found = outstanding.find(*id);
+          if(found == outstanding.end())
+          {
+            // already answered (e.g. given up on by the drain), a late reply.
+            continue;
+          }
+          if(done)
+          {
+            outstanding.erase(found);
+          }
+        }
+        this->ctx.write(v);
+        if(done)
+        {
+          complete(*id);
+        }
+      }
+    }
+
+    /** Fails the invokes of the gone worker `i`, restarts it unless the pod
+     * stops. Returns the new worker's transport, or `nullptr`.
+     */
+    std::shared_ptr<FdTransport> restart(std::size_t i, std::shared_ptr<FdTransport> const &dead)
+    {
+      auto &w = *_workers[i];
+      std::multiset<std::string> lost;
+      pid_t pid{};
+      std::chrono::steady_clock::time_point started{};
+      {
+        std::lock_guard<std::mutex> lock(w.lock);
+        lost.swap(w.outstanding);
+        pid = w.pid;
+        started = w.started;
+      }
+      dead->shutdown_write();
+      // waited for without reaping, `stop_workers` may still signal the pid.
+      siginfo_t info{};
+      ::waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOWAIT);
+      {
+        std::lock_guard<std::mutex> lock(w.lock);
+        int status{};
+        ::waitpid(pid, &status, 0);
+        w.pid = -1;
+      }
+      for(auto &id : lost)
+      {
+        this->ctx.send_invoke_error(id, "worker exited before the invoke finished");
+        complete(id);
+      }
+      if(!_stopping.load())
+      {
+        // a worker failing on start would otherwise be restarted in a loop.
+        if(std::chrono::steady_clock::now() - started < std::chrono::seconds{ 1 })
+        {
+          std::this_thread::sleep_for(std::chrono::seconds{ 1 });
+        }
+        try
+        {
+          return spawn(i);
+        }
+        catch(std::exception const &e)
+        {
+          std::cerr << "prefork: restarting worker " << i << " failed: " << e.what() << "\n";
+        }
+      }
+      return nullptr;
+    }
+
+    void complete(std::string const &id)
+    {
+      std::size_t charged{ 0 };
+      {
+        std::lock_guard<std::mutex> lock(this->_pendings_lock);
+        if(auto it = this->_pendings.find(id); it != this->_pendings.end())
+        {
+          charged = it->second.encoded_args.size();
+          this->_pendings.erase(it);
+        }
+      }
+      this->ctx.memory.release(charged);
+      this->finish_inflight(id);
+    }
+
+    std::vector<std::string> const _argv;
+    std::string _exe;
+    Routing const _routing;
+    std::atomic_size_t _next{ 0 };
+    std::vector<std::unique_ptr<worker>> _workers;
+    std::atomic_bool _stopping{ false };
+    std::mutex _readers_lock;
+    std::condition_variable _readers_cv;
+    int _readers{ 0 };
+    /** One per worker, restarts included. */
+    std::vector<std::thread> _relays;
+  };
+}
+
+#endif // POD_PREFORK_H_
@@ -0,0 +1,339 @@
+#ifndef POD_PROFILE_H_
+#define POD_PROFILE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <csignal>
+#include <ctime>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#endif
+
+// Sampling CPU profiler (Linux only).
+//
+// While a profile runs, a process CPU time timer raises SIGPROF, the handler
+// unwinds the interrupted thread's stack into a preallocated sample & tags it
+// with the invoke running on that thread. The samples are symbolized after the
+// run & folded (`var;invoke id;outer;...;leaf` -> count), ready for
+// flamegraph.pl or speedscope. Symbol names need the executable's symbols to be
+// exported (`-rdynamic`), other frames show as `module+offset`.
+//
+// When no profile runs, the cost is the thread local `Scope` set around each
+// invoke.
+
+namespace lotuc::pod::profile
+{
+  /** The invoke running on a thread, the strings outlive the invoke. */
+  struct Running
+  {
+    std::string const &ns;
+    std::string const &var;
+    std::string const &id;
+  };
+
+  inline thread_local Running const *running{ nullptr };
+
+  /** Attributes the thread's samples to `r` for its lifetime. */
+  class Scope
+  {
+  public:
+    explicit Scope(Running const &r)
+      : _prev{ running }
+    {
+      running = &r;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+
+    ~Scope()
+    {
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      running = _prev;
+    }
+
+    Scope(Scope const &) = delete;
+    Scope &operator=(Scope const &) = delete;
+
+  private:
+    Running const *_prev;
+  };
+
+  class Profiler
+  {
+  public:
+    static constexpr int max_depth = 64;
+    static constexpr std::size_t max_samples = 1 << 16;
+    static constexpr int max_hz = 10000;
+    static constexpr std::chrono::seconds max_duration{ 3600 };
+
+    static Profiler &instance()
+    {
+      static Profiler p;
+      return p;
+    }
+
+    /** Samples the process for `duration` at `hz` (per CPU second), returns
+     * the folded stacks & their sample counts. Only one profile runs at a
+     * time.
+     */
+    std::map<std::string, long long> run(std::chrono::milliseconds duration, int hz = 99)
+    {
+#ifdef __linux__
+      std::unique_lock<std::mutex> lock(_lock, std::try_to_lock);
+      if(!lock.owns_lock())
+      {
+        throw std::runtime_error{ "a profile is already running" };
+      }
+      if(hz <= 0 || hz > max_hz || duration.count() <= 0 || duration > max_duration)
+      {
+        throw std::invalid_argument{ "expects 0 < duration <= 1h & 0 < hz <= 10000" };
+      }
+      auto cpus = std::max(1u, std::thread::hardware_concurrency());
+      auto expected = static_cast<std::size_t>(hz * (duration.count() / 1000.0 + 1) * cpus);
+      _samples.assign(std::min(expected, max_samples), Sample{});
+      _next.store(0);
+      _dropped.store(0);
+
+      // the first unwind loads libgcc, it must not happen in the handler.
+      void *warm[1];
+      ::backtrace(warm, 1);
+      std::call_once(_installed, []() {
+        struct sigaction sa{};
+        sa.sa_sigaction = &Profiler::on_signal;
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        ::sigaction(SIGPROF, &sa, nullptr);
+      });
+
+      sigevent ev{};
+      ev.sigev_notify = SIGEV_SIGNAL;
+      ev.sigev_signo = SIGPROF;
+      timer_t timer{};
+      if(::timer_create(CLOCK_PROCESS_CPUTIME_ID, &ev, &timer) != 0)
+      {
+        throw std::system_error{ errno, std::generic_category(), "timer_create" };
+      }
+      auto interval_ns = 1000000000L / hz;
+      itimerspec spec{};
+      spec.it_interval.tv_sec = interval_ns / 1000000000L;
+      spec.it_interval.tv_nsec = interval_ns % 1000000000L;
+      spec.it_value = spec.it_interval;
+
+      _active.store(true);
+      ::timer_settime(timer, 0, &spec, nullptr);
+      std::this_thread::sleep_for(duration);
+      ::timer_delete(timer);
+      _active.store(false);
+      // the handler stays installed, a late signal finds the profiler off.
+      while(_in_handler.load() > 0)
+      {
+        std::this_thread::yield();
+      }
+
+      auto folded = fold(std::min(_next.load(), _samples.size()));
+      if(auto dropped = _dropped.load(); dropped > 0)
+      {
+        folded["[dropped]"] += static_cast<long long>(dropped);
+      }
+      _samples.clear();
+      _samples.shrink_to_fit();
+      return folded;
+#else
+      (void)duration;
+      (void)hz;
+      throw std::runtime_error{ "profiling is only supported on Linux" };
+#endif
+    }
+
+  private:
+    struct Sample
+    {
+      int depth;
+      void *pcs[max_depth];
+      char var[96];
+      char id[40];
+    };
+
+    std::mutex _lock;
+    std::once_flag _installed;
+    std::vector<Sample> _samples;
+    std::atomic_bool _active{ false };
+    std::atomic<std::size_t> _next{ 0 };
+    std::atomic<std::size_t> _dropped{ 0 };
+    std::atomic_int _in_handler{ 0 };
+
+#ifdef __linux__
+    /** Copies `s` into `out` up to `n` bytes from `at`, returns the new end. */
+    static std::size_t put(char *out, std::size_t at, std::size_t n, std::string_view s)
+    {
+      auto len = std::min(s.size(), n - 1 - at);
+      std::memcpy(out + at, s.data(), len);
+      return at + len;
+    }
+
+    static void on_signal(int, siginfo_t *, void *)
+    {
+      auto &p = instance();
+      // counted in before looking: `run` turns the profile off then waits for
+      // the handlers in, one seeing it still on is waited for.
+      p._in_handler.fetch_add(1);
+      if(!p._active.load())
+      {
+        p._in_handler.fetch_sub(1);
+        return;
+      }
+      auto saved_errno = errno;
+      auto i = p._next.fetch_add(1, std::memory_order_relaxed);
+      if(i < p._samples.size())
+      {
+        auto &s = p._samples[i];
+        s.depth = ::backtrace(s.pcs, max_depth);
+        s.var[0] = s.id[0] = '\0';
+        if(auto r = running; r != nullptr)
+        {
+          auto n = put(s.var, 0, sizeof(s.var), r->ns);
+          n = put(s.var, n, sizeof(s.var), "/");
+          s.var[put(s.var, n, sizeof(s.var), r->var)] = '\0';
+          s.id[put(s.id, 0, sizeof(s.id), r->id)] = '\0';
+        }
+      }
+      else
+      {
+        p._dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+      p._in_handler.fetch_sub(1);
+      errno = saved_errno;
+    }
+
+    /** Drops the parameter list & the template arguments of a demangled
+     * name, the stacks stay readable.
+     */
+    static std::string short_name(std::string const &name)
+    {
+      auto end = name.size();
+      if(name.ends_with(" const"))
+      {
+        end -= 6;
+      }
+      if(end > 0 && name[end - 1] == ')')
+      {
+        int depth = 0;
+        for(auto i = end; i-- > 0;)
+        {
+          depth += name[i] == ')' ? 1 : name[i] == '(' ? -1 : 0;
+          if(depth == 0)
+          {
+            end = i;
+            break;
+          }
+        }
+      }
+      std::string out;
+      int depth = 0;
+      for(std::size_t i = 0; i < end; i++)
+      {
+        auto c = name[i];
+        auto op = std::string_view{ out }.ends_with("operator")
+                  || std::string_view{ out }.ends_with("operator<");
+        if(c == '<' && depth == 0 && op)
+        {
+          out += c;
+        }
+        else if(c == '<')
+        {
+          depth++;
+        }
+        else if(c == '>' && depth > 0)
+        {
+          if(--depth == 0)
+          {
+            out += "<>";
+          }
+        }
+        else if(depth == 0)
+        {
+          out += c;
+        }
+      }
+      return out;
+    }
+
+    static std::string symbol(void *pc)
+    {
+      Dl_info info{};
+      if(::dladdr(pc, &info) == 0)
+      {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%p", pc);
+        return buf;
+      }
+      if(info.dli_sname != nullptr)
+      {
+        int status{};
+        auto demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        if(status == 0 && demangled != nullptr)
+        {
+          std::string name{ demangled };
+          std::free(demangled);
+          return short_name(name);
+        }
+        return info.dli_sname;
+      }
+      std::string module{ info.dli_fname != nullptr ? info.dli_fname : "?" };
+      module = module.substr(module.find_last_of('/') + 1);
+      char buf[32];
+      std::snprintf(buf,
+                    sizeof(buf),
+                    "+0x%lx",
+                    static_cast<unsigned long>(static_cast<char *>(pc)
+                                               - static_cast<char *>(info.dli_fbase)));
+      return module + buf;
+    }
+
+    std::map<std::string, long long> fold(std::size_t n)
+    {
+      // the handler's own frame & the signal trampoline.
+      constexpr int skip = 2;
+      std::map<void *, std::string> symbols;
+      std::map<std::string, long long> folded;
+      for(std::size_t i = 0; i < n; i++)
+      {
+        auto &s = _samples[i];
+        std::string stack = s.var[0] != '\0' ? s.var + std::string{ ";invoke " } + s.id : "[pod]";
+        for(auto f = s.depth - 1; f >= skip; f--)
+        {
+          // return addresses point past the call, the leaf is the interrupted
+          // instruction itself.
+          auto pc = f == skip ? s.pcs[f] : static_cast<char *>(s.pcs[f]) - 1;
+          auto it = symbols.find(pc);
+          if(it == symbols.end())
+          {
+            it = symbols.emplace(pc, symbol(pc)).first;
+          }
+          stack += ';';
+          stack += it->second;
+        }
+        folded[stack]++;
+      }
+      return folded;
+    }
+#endif
+  };
+}
+
+#endif // POD_PROFILE_H_
@@ -0,0 +1,124 @@
+#ifndef POD_QUEUE_H_
+#define POD_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace lotuc::pod
+{
+  /** A bounded single producer single consumer queue. `push` blocks while
+   * the queue is full, `pop` blocks while it's empty.
+   */
+  template <typename T>
+  class SpscQueue
+  {
+  public:
+    explicit SpscQueue(std::size_t capacity)
+      : _slots(capacity)
+    {
+    }
+
+    SpscQueue(SpscQueue const &) = delete;
+    SpscQueue &operator=(SpscQueue const &) = delete;
+
+    void push(T v)
+    {
+      auto tail = _tail.load(std::memory_order_relaxed);
+      auto head = _head.load(std::memory_order_acquire);
+      while(tail - head == _slots.size())
+      {
+        _head.wait(head, std::memory_order_acquire);
+        head = _head.load(std::memory_order_acquire);
+      }
+      _slots[tail % _slots.size()].emplace(std::move(v));
+      _tail.store(tail + 1, std::memory_order_release);
+      _tail.notify_one();
+    }
+
+    std::optional<T> try_pop()
+    {
+      auto head = _head.load(std::memory_order_relaxed);
+      if(_tail.load(std::memory_order_acquire) == head)
+      {
+        return std::nullopt;
+      }
+      return pop();
+    }
+
+    T pop()
+    {
+      auto head = _head.load(std::memory_order_relaxed);
+      while(_tail.load(std::memory_order_acquire) == head)
+      {
+        _tail.wait(head, std::memory_order_acquire);
+      }
+      auto &slot = _slots[head % _slots.size()];
+      T v = std::move(slot.value());
+      slot.reset();
+      _head.store(head + 1, std::memory_order_release);
+      _head.notify_one();
+      return v;
+    }
+
+  private:
+    std::vector<std::optional<T>> _slots;
+    alignas(64) std::atomic<std::size_t> _head{};
+    alignas(64) std::atomic<std::size_t> _tail{};
+  };
+
+  /** Two SPSC lanes sharing one producer & one consumer, `pop` takes from the
+   * high priority lane first.
+   */
+  template <typename T>
+  class LaneQueue
+  {
+  public:
+    explicit LaneQueue(std::size_t capacity)
+      : _high{ capacity }
+      , _low{ capacity }
+    {
+    }
+
+    void push(T v, bool high)
+    {
+      (high ? _high : _low).push(std::move(v));
+      _pushed.fetch_add(1, std::memory_order_release);
+      _pushed.notify_one();
+    }
+
+    T pop()
+    {
+      while(true)
+      {
+        auto pushed = _pushed.load(std::memory_order_acquire);
+        if(auto v = try_pop(); v.has_value())
+        {
+          return std::move(v.value());
+        }
+        _pushed.wait(pushed, std::memory_order_acquire);
+      }
+    }
+
+    std::optional<T> try_pop()
+    {
+      if(auto v = _high.try_pop(); v.has_value())
+      {
+        return v;
+      }
+      return _low.try_pop();
+    }
+
+    /** Takes from the low priority lane only. */
+    std::optional<T> try_pop_low() { return _low.try_pop(); }
+
+  private:
+    SpscQueue<T> _high;
+    SpscQueue<T> _low;
+    std::atomic<std::size_t> _pushed{};
+  };
+}
+
+#endif // POD_QUEUE_H_
@@ -0,0 +1,249 @@
+#ifndef POD_RECORD_H_
+#define POD_RECORD_H_
+
+#include "pod.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Traffic capture, for replaying production traffic against new builds (see
+// `src-dev/cpp/pod_replay.cpp`).
+//
+// The log starts with the `recording::magic` line & a format byte (`b` for
+// bencode frames, `j` for JSON-RPC lines), followed by the frames:
+//
+//   [dir: u8, '<' read / '>' written][ts: u64, us since start][len: u64][bytes]
+//
+// integers in host byte order (`len` is a u32 in the logs of `magic_v1`). The
+// frames are logged as they are on the wire, in the order they are written.
+
+namespace lotuc::pod
+{
+  namespace recording
+  {
+    inline constexpr std::string_view magic{ "PODREC2\n" };
+    inline constexpr std::string_view magic_v1{ "PODREC1\n" };
+
+    struct Frame
+    {
+      char dir;
+      std::uint64_t ts_us;
+      std::string bytes;
+    };
+
+    class Writer
+    {
+    public:
+      Writer(std::string const &path, char format)
+        : _out{ path, std::ios::binary | std::ios::trunc }
+      {
+        if(!_out)
+        {
+          throw std::runtime_error{ "cannot open recording: " + path };
+        }
+        _out.write(magic.data(), static_cast<std::streamsize>(magic.size()));
+        _out.put(format);
+        _flusher = std::thread{ &Writer::run, this };
+      }
+
+      ~Writer()
+      {
+        {
+          std::lock_guard<std::mutex> lock(_lock);
+          _stopping = true;
+          _wake.notify_all();
+        }
+        _flusher.join();
+        _out.flush();
+      }
+
+      Writer(Writer const &) = delete;
+      Writer &operator=(Writer const &) = delete;
+
+      /** The frames are flushed in batches, every interval (by a thread of
+       * the writer's own): a killed process loses the frames of the last
+       * one.
+       */
+      std::chrono::milliseconds flush_interval{ 100 };
+
+      void record(char dir, std::string_view bytes)
+      {
+        auto len = static_cast<std::uint64_t>(bytes.size());
+        // stamped under the lock, so the frames are in time order.
+        std::lock_guard<std::mutex> lock(_lock);
+        auto ts = static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - _start)
+            .count());
+        _out.put(dir);
+        _out.write(reinterpret_cast<char const *>(&ts), sizeof(ts));
+        _out.write(reinterpret_cast<char const *>(&len), sizeof(len));
+        _out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        _dirty = true;
+      }
+
+      void flush()
+      {
+        std::lock_guard<std::mutex> lock(_lock);
+        _out.flush();
+      }
+
+    private:
+      std::mutex _lock;
+      std::ofstream _out;
+      std::chrono::steady_clock::time_point const _start{ std::chrono::steady_clock::now() };
+      std::condition_variable _wake;
+      bool _dirty{ false };
+      bool _stopping{ false };
+      std::thread _flusher;
+
+      void run()
+      {
+        std::unique_lock<std::mutex> lock(_lock);
+        while(!_stopping)
+        {
+          _wake.wait_for(lock, flush_interval, [this] { return _stopping; });
+          if(_dirty)
+          {
+            _out.flush();
+            _dirty = false;
+          }
+        }
+      }
+    };
+
+    class Reader
+    {
+    public:
+      explicit Reader(std::string const &path)
+        : _in{ path, std::ios::binary }
+      {
+        std::string head(magic.size(), '\0');
+        if(!_in.read(head.data(), static_cast<std::streamsize>(head.size()))
+           || (head != magic && head != magic_v1))
+        {
+          throw std::runtime_error{ "not a pod recording: " + path };
+        }
+        _v1 = head == magic_v1;
+        format = static_cast<char>(_in.get());
+      }
+
+      char format{};
+
+      std::optional<Frame> next()
+      {
+        Frame f{};
+        std::uint64_t len{};
+        std::uint32_t len_v1{};
+        if(!_in.get(f.dir) || !_in.read(reinterpret_cast<char *>(&f.ts_us), sizeof(f.ts_us))
+           || !(_v1 ? _in.read(reinterpret_cast<char *>(&len_v1), sizeof(len_v1))
+                    : _in.read(reinterpret_cast<char *>(&len), sizeof(len))))
+        {
+          return std::nullopt;
+        }
+        if(_v1)
+        {
+          len = len_v1;
+        }
+        f.bytes.resize(len);
+        if(!_in.read(f.bytes.data(), static_cast<std::streamsize>(len)))
+        {
+          return std::nullopt;
+        }
+        return f;
+      }
+
+    private:
+      std::ifstream _in;
+      bool _v1{ false };
+    };
+  }
+
+  /** Records the frames passing through a bencode transport: the bytes read,
+   * & the written ones under the lock of the writes, so the log has them in
+   * the order they went out.
+   */
+  class RecordingTransport : public BencodeTransport
+  {
+  public:
+    RecordingTransport(std::unique_ptr<BencodeTransport> transport, std::string const &path)
+      : _transport{ std::move(transport) }
+      , _log{ path, 'b' }
+    {
+    }
+
+    bc::data read() override
+    {
+      std::string raw;
+      auto v = _transport->read_raw(raw);
+      _log.record('<', raw);
+      return v;
+    }
+
+    void write(bc::data const &d) override
+    {
+      auto frame = bc::encode(d);
+      std::lock_guard<std::mutex> lock(_write_lock);
+      _log.record('>', frame);
+      if(_transport->writes_encoded())
+      {
+        _transport->write_encoded(frame);
+      }
+      else
+      {
+        _transport->write(d);
+      }
+    }
+
+    void write_encoded(std::string_view frame) override
+    {
+      std::lock_guard<std::mutex> lock(_write_lock);
+      _log.record('>', frame);
+      _transport->write_encoded(frame);
+    }
+
+    bool writes_encoded() const override
+    {
+      return _transport->writes_encoded();
+    }
+
+    void flush() override
+    {
+      _transport->flush();
+      _log.flush();
+    }
+
+    void close() override
+    {
+      _transport->close();
+    }
+
+    bool closed() const override
+    {
+      return _transport->closed();
+    }
+
+    std::map<std::string, long long> stats() override
+    {
+      return _transport->stats();
+    }
+
+  private:
+    std::unique_ptr<BencodeTransport> _transport;
+    recording::Writer _log;
+    std::mutex _write_lock;
+  };
+}
+
+#endif // POD_RECORD_H_
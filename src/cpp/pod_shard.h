@@ -0,0 +1,222 @@
+#ifndef POD_SHARD_H_
+#define POD_SHARD_H_
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Component state shared by vars running on many threads.
+//
+// `Sharded<S>`: write-mostly state (counters, histograms, ...). Each thread
+// updates its own cache line aligned shard without contention, readers merge
+// all the shards. Invokes run on short lived threads, so the shard of an
+// exited thread is handed to the next thread instead of being dropped.
+//
+// `Published<S>`: read-mostly state. Readers take the current immutable
+// snapshot without locking, writers copy, modify & publish a new one (RCU
+// style); old snapshots live as long as a reader holds them.
+
+namespace lotuc::pod
+{
+  template <typename S>
+  class Sharded
+  {
+  public:
+    Sharded()
+      : _state{ std::make_shared<state>() }
+    {
+    }
+
+    Sharded(Sharded const &) = delete;
+    Sharded &operator=(Sharded const &) = delete;
+
+    /** The calling thread's shard. It's also read by `aggregate` from other
+     * threads, so `S` is expected to be updated atomically (relaxed atomics
+     * are enough, the shard's cache line is not shared).
+     */
+    S &local()
+    {
+      thread_local std::vector<held> cache;
+      for(auto &h : cache)
+      {
+        // an expired entry may share the address of a newer state.
+        if(h.key == _state.get() && !h.owner.expired())
+        {
+          return h.s->value;
+        }
+      }
+      // the shards of destroyed `Sharded`s are dropped from the cache.
+      std::erase_if(cache, [](held const &h) { return h.owner.expired(); });
+      cache.emplace_back(_state, _state->acquire());
+      return cache.back().s->value;
+    }
+
+    /** Folds all the shards: `r = merge(r, shard)`. */
+    template <typename R, typename F>
+    R aggregate(R init, F merge) const
+    {
+      std::lock_guard<std::mutex> lock(_state->lock);
+      for(auto &s : _state->shards)
+      {
+        init = merge(std::move(init), const_cast<S const &>(s.value));
+      }
+      return init;
+    }
+
+  private:
+    struct alignas(64) shard
+    {
+      S value{};
+    };
+
+    struct state
+    {
+      std::mutex lock;
+      std::deque<shard> shards;
+      std::vector<shard *> released;
+
+      shard *acquire()
+      {
+        std::lock_guard<std::mutex> g(lock);
+        if(!released.empty())
+        {
+          auto s = released.back();
+          released.pop_back();
+          return s;
+        }
+        return &shards.emplace_back();
+      }
+
+      void release(shard *s)
+      {
+        std::lock_guard<std::mutex> g(lock);
+        released.push_back(s);
+      }
+    };
+
+    /** A thread's shard, given back when the thread exits. The cache does
+     * not keep the state of a destroyed `Sharded` alive.
+     */
+    struct held
+    {
+      state const *key;
+      std::weak_ptr<state> owner;
+      shard *s;
+
+      held(std::shared_ptr<state> const &owner, shard *s)
+        : key{ owner.get() }
+        , owner{ owner }
+        , s{ s }
+      {
+      }
+
+      held(held &&o) noexcept
+        : key{ o.key }
+        , owner{ std::move(o.owner) }
+        , s{ o.s }
+      {
+      }
+
+      held &operator=(held &&o) noexcept
+      {
+        give_back();
+        key = o.key;
+        owner = std::move(o.owner);
+        s = o.s;
+        return *this;
+      }
+
+      ~held()
+      {
+        give_back();
+      }
+
+      void give_back()
+      {
+        if(auto o = owner.lock(); o)
+        {
+          o->release(s);
+        }
+        owner.reset();
+      }
+    };
+
+    std::shared_ptr<state> _state;
+  };
+
+  /** A counter sharded per thread. */
+  class ShardedCounter
+  {
+  public:
+    void add(long long n = 1)
+    {
+      _shards.local().fetch_add(n, std::memory_order_relaxed);
+    }
+
+    long long sum() const
+    {
+      return _shards.aggregate(0LL, [](long long r, std::atomic_llong const &v) {
+        return r + v.load(std::memory_order_relaxed);
+      });
+    }
+
+  private:
+    Sharded<std::atomic_llong> _shards;
+  };
+
+  template <typename S>
+  class Published
+  {
+  public:
+    Published()
+      : _current{ std::make_shared<S const>() }
+    {
+    }
+
+    explicit Published(S init)
+      : _current{ std::make_shared<S const>(std::move(init)) }
+    {
+    }
+
+    /** The current snapshot, never blocks on writers. */
+    std::shared_ptr<S const> load() const
+    {
+      // the free functions, std::atomic<std::shared_ptr> is not in every
+      // standard library yet.
+      return std::atomic_load_explicit(&_current, std::memory_order_acquire);
+    }
+
+    void publish(S next)
+    {
+      std::lock_guard<std::mutex> lock(_write_lock);
+      store(std::make_shared<S const>(std::move(next)));
+    }
+
+    /** Copies the current snapshot, modifies it with `f` & publishes it.
+     * Writers are serialized, readers are not blocked.
+     */
+    template <typename F>
+    void update(F f)
+    {
+      std::lock_guard<std::mutex> lock(_write_lock);
+      S next = *load();
+      f(next);
+      store(std::make_shared<S const>(std::move(next)));
+    }
+
+  private:
+    std::shared_ptr<S const> _current;
+    std::mutex _write_lock;
+
+    void store(std::shared_ptr<S const> next)
+    {
+      std::atomic_store_explicit(&_current, std::move(next), std::memory_order_release);
+    }
+  };
+}
+
+#endif // POD_SHARD_H_
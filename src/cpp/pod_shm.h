@@ -0,0 +1,239 @@
+#ifndef POD_SHM_H_
+#define POD_SHM_H_
+
+#include "pod.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+// Shared memory side channel for bulk payloads (POSIX only).
+//
+// The payload lives in a file that both the pod and a local client can map
+// (under `/dev/shm` when available), messages only carry the `ShmHandle`.
+// The one who creates the file owns it: files of arguments are removed by the
+// client, files of results are removed by the client after reading them
+// (or by the pod with `ShmRegion::unlink`).
+
+namespace lotuc::pod
+{
+  namespace shm
+  {
+    inline std::string errno_message(std::string const &what)
+    {
+      return what + ": " + std::strerror(errno);
+    }
+
+    inline std::string default_dir()
+    {
+      auto dir = getenv("POD_SHM_DIR");
+      if(!dir.empty())
+      {
+        return dir;
+      }
+      if(std::filesystem::is_directory("/dev/shm"))
+      {
+        return "/dev/shm";
+      }
+      return std::filesystem::temp_directory_path().string();
+    }
+
+    /** Whether the path names a file inside `dir`, after resolving its `..`
+     * components & symlinks.
+     */
+    inline bool is_within(std::string const &path, std::string const &dir)
+    {
+      std::error_code ec;
+      auto base = std::filesystem::weakly_canonical(dir, ec);
+      if(ec)
+      {
+        return false;
+      }
+      auto file = std::filesystem::weakly_canonical(path, ec);
+      if(ec)
+      {
+        return false;
+      }
+      auto rel = file.lexically_relative(base);
+      return !rel.empty() && *rel.begin() != ".." && rel != ".";
+    }
+
+    inline std::string unique_path(std::string const &dir)
+    {
+      static std::atomic_int seq{};
+      return dir + "/babashka-pod-" + std::to_string(getpid()) + "-"
+        + std::to_string(seq.fetch_add(1)) + ".shm";
+    }
+  }
+
+  /** A read only mapping of the payload referenced by a handle. */
+  class ShmPayload
+  {
+  public:
+    // clang-format off
+
+    ShmPayload(ShmPayload const &) = delete;
+    ShmPayload &operator=(ShmPayload const &) = delete;
+    ShmPayload(ShmPayload &&o) noexcept
+      : _base{ o._base } , _size{ o._size } , _data{ o._data } , _length{ o._length }
+    { o._base = nullptr; }
+    ~ShmPayload() { if(_base != nullptr) { ::munmap(_base, _size); } }
+
+    char const *data() const { return _data; }
+    std::size_t size() const { return _length; }
+    std::string_view view() const { return { _data, _length }; }
+
+    // clang-format on
+
+    static ShmPayload map(ShmHandle const &h)
+    {
+      int fd = ::open(h.path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+      if(fd < 0)
+      {
+        throw std::runtime_error{ shm::errno_message("cannot open " + h.path) };
+      }
+      ScopeGuard _close{ [fd]() { ::close(fd); } };
+
+      // mapping past the file's end would fault on the first touch.
+      struct stat st{};
+      if(::fstat(fd, &st) != 0)
+      {
+        throw std::runtime_error{ shm::errno_message("cannot stat " + h.path) };
+      }
+      auto file_size = static_cast<std::size_t>(st.st_size);
+      if(!S_ISREG(st.st_mode) || h.offset > file_size || h.length > file_size - h.offset)
+      {
+        throw std::runtime_error{ "shm handle out of the bounds of " + h.path };
+      }
+
+      // mmap offset must be aligned to pages.
+      auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+      auto aligned = h.offset / page * page;
+      auto size = h.length + (h.offset - aligned);
+      if(size == 0)
+      {
+        return ShmPayload{ nullptr, 0, nullptr, 0 };
+      }
+      void *base = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(aligned));
+      if(base == MAP_FAILED)
+      {
+        throw std::runtime_error{ shm::errno_message("cannot map " + h.path) };
+      }
+      return ShmPayload{ base, size, static_cast<char *>(base) + (h.offset - aligned), h.length };
+    }
+
+  private:
+    void *_base;
+    std::size_t _size;
+    char const *_data;
+    std::size_t _length;
+
+    ShmPayload(void *base, std::size_t size, char const *data, std::size_t length)
+      : _base{ base }
+      , _size{ size }
+      , _data{ data }
+      , _length{ length }
+    {
+    }
+  };
+
+  /** A writable shared memory file, for returning bulk results by handle. */
+  class ShmRegion
+  {
+  public:
+    // clang-format off
+
+    ShmRegion(ShmRegion const &) = delete;
+    ShmRegion &operator=(ShmRegion const &) = delete;
+    ShmRegion(ShmRegion &&o) noexcept
+      : _path{ std::move(o._path) } , _data{ o._data } , _length{ o._length }
+    { o._data = nullptr; }
+    ~ShmRegion() { if(_data != nullptr) { ::munmap(_data, _length); } }
+
+    char *data() { return _data; }
+    std::size_t size() const { return _length; }
+    ShmHandle handle() const { return ShmHandle{ _path, 0, _length }; }
+    void unlink() const { ::unlink(_path.c_str()); }
+
+    // clang-format on
+
+    static ShmRegion create(std::size_t length)
+    {
+      return create(length, shm::default_dir());
+    }
+
+    static ShmRegion create(std::size_t length, std::string const &dir)
+    {
+      auto path = shm::unique_path(dir);
+      int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+      if(fd < 0)
+      {
+        throw std::runtime_error{ shm::errno_message("cannot create " + path) };
+      }
+      ScopeGuard _close{ [fd]() { ::close(fd); } };
+      if(::ftruncate(fd, static_cast<off_t>(length)) != 0)
+      {
+        ::unlink(path.c_str());
+        throw std::runtime_error{ shm::errno_message("cannot resize " + path) };
+      }
+      if(length == 0)
+      {
+        return ShmRegion{ path, nullptr, 0 };
+      }
+      void *data = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if(data == MAP_FAILED)
+      {
+        ::unlink(path.c_str());
+        throw std::runtime_error{ shm::errno_message("cannot map " + path) };
+      }
+      return ShmRegion{ path, static_cast<char *>(data), length };
+    }
+
+  private:
+    std::string _path;
+    char *_data;
+    std::size_t _length;
+
+    ShmRegion(std::string path, char *data, std::size_t length)
+      : _path{ std::move(path) }
+      , _data{ data }
+      , _length{ length }
+    {
+    }
+  };
+
+  /** Maps the payload if the value is a shared memory handle. The mapping is
+   * lazy: nothing is read until the returned payload's data is touched.
+   *
+   * Handles come from the client, only files inside `dir` (the shm directory
+   * by default, `POD_SHM_DIR` when set) are mapped, others are rejected.
+   */
+  template <typename T>
+  inline std::optional<ShmPayload>
+  resolve_shm(Encoder<T> &encoder, T const &v, std::string const &dir = shm::default_dir())
+  {
+    auto h = encoder.shm_handle(v);
+    if(!h.has_value())
+    {
+      return std::nullopt;
+    }
+    if(!shm::is_within(h->path, dir))
+    {
+      throw std::runtime_error{ "shm handle outside of " + dir + ": " + h->path };
+    }
+    return ShmPayload::map(h.value());
+  }
+}
+
+#endif // POD_SHM_H_
@@ -0,0 +1,100 @@
+#ifndef POD_SNAPSHOT_H_
+#define POD_SNAPSHOT_H_
+
+#include "pod.h"
+#include "pod_shm.h"
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Snapshot of expensive component state.
+//
+// The components are built once & saved as an image file; later starts map
+// the image and restore from it instead of rebuilding. What goes into the
+// image is up to the `save`/`restore` functions (for plain data, the bytes of
+// the struct).
+
+namespace lotuc::pod
+{
+  template <typename C>
+  struct Snapshot
+  {
+    std::string path;
+    std::function<std::string(C const &)> save;
+    std::function<void(C &, std::string_view image)> restore;
+  };
+
+  namespace snapshot
+  {
+    /** Writes to a temporary file first, a crash never leaves a torn image. */
+    inline void write_image(std::string const &path, std::string const &image)
+    {
+      auto tmp = path + ".tmp";
+      {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(image.data(), static_cast<std::streamsize>(image.size()));
+        if(!out)
+        {
+          throw std::runtime_error{ "cannot write snapshot: " + tmp };
+        }
+      }
+      std::filesystem::rename(tmp, path);
+    }
+  }
+
+  /** Warms the components up from the snapshot if there is a usable one,
+   * otherwise builds them & saves the snapshot for the next start (a failed
+   * save is logged, the warm up still succeeds).
+   *
+   * Records `snapshot-load-ms`, or `build-ms` & `snapshot-save-ms`, in the
+   * context's startup metrics.
+   */
+  template <typename T, typename C>
+  inline void
+  warm_up_with_snapshot(Context<T, C> &ctx, Snapshot<C> snapshot, std::function<void(C &)> build)
+  {
+    ctx.warm_up([&ctx, snapshot = std::move(snapshot), build = std::move(build)](C &c) {
+      auto start = ctx.since_created_ms();
+      std::error_code ec;
+      auto size = std::filesystem::file_size(snapshot.path, ec);
+      if(!ec && snapshot.restore)
+      {
+        try
+        {
+          auto image = ShmPayload::map(ShmHandle{ snapshot.path, 0, size });
+          snapshot.restore(c, image.view());
+          ctx.record_startup("snapshot-load-ms", ctx.since_created_ms() - start);
+          return;
+        }
+        catch(std::exception const &)
+        {
+          // an unusable image is rebuilt.
+        }
+      }
+
+      build(c);
+      ctx.record_startup("build-ms", ctx.since_created_ms() - start);
+      if(snapshot.save && !snapshot.path.empty())
+      {
+        start = ctx.since_created_ms();
+        try
+        {
+          snapshot::write_image(snapshot.path, snapshot.save(c));
+          ctx.record_startup("snapshot-save-ms", ctx.since_created_ms() - start);
+        }
+        catch(std::exception const &e)
+        {
+          // the components are built, only the next start pays for it.
+          std::cerr << "snapshot: saving " << snapshot.path << " failed: " << e.what() << "\n";
+        }
+      }
+    });
+  }
+}
+
+#endif // POD_SNAPSHOT_H_
@@ -0,0 +1,558 @@
+#ifndef POD_TIMER_H_
+#define POD_TIMER_H_
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Hierarchical timer wheel (1 ms ticks), for delayed callbacks, periodic
+// emission & deadlines without a parked thread per timer.
+//
+// Level 0 has a slot per tick for the next 256 ms, each upper level has 64
+// slots covering the whole lower level; timers are moved down a level when
+// their slot comes up. Scheduling & cancelling are O(1); cancelled timers are
+// dropped lazily from their slot.
+//
+// The callbacks run on the wheel's thread (started by the first timer), they
+// must be short & must not block: a write to a client that stops reading
+// would stall every timer. Hand longer work to a `Strand`, run by a bounded
+// `StrandPool` (which is what the invoke's `after`/`every` & its batch timer
+// do). A wheel (or pool) destroyed from its own callback leaves its thread
+// to return once the callback does.
+
+namespace lotuc::pod
+{
+  class TimerWheel;
+
+  /** A scheduled timer, cancellable. */
+  class Timer
+  {
+  public:
+    Timer() = default;
+
+    Timer(TimerWheel *wheel, std::uint64_t id)
+      : _wheel{ wheel }
+      , _id{ id }
+    {
+    }
+
+    /** Cancels the timer, returns false if it already fired (one shot) or
+     * was cancelled. Once returned, the callback is not running, unless
+     * cancelled from the callback itself.
+     */
+    bool cancel();
+
+    explicit operator bool() const { return _wheel != nullptr; }
+
+  private:
+    TimerWheel *_wheel{ nullptr };
+    std::uint64_t _id{ 0 };
+  };
+
+  class TimerWheel
+  {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    TimerWheel() = default;
+
+    /** From one of its callbacks (the callback owned the wheel's last
+     * reference), its thread is detached & returns after the callback.
+     */
+    ~TimerWheel()
+    {
+      {
+        std::lock_guard<std::mutex> lock(_lock);
+        _stopping = true;
+        _wake.notify_all();
+      }
+      if(!_thread.joinable())
+      {
+        return;
+      }
+      if(std::this_thread::get_id() == _thread.get_id())
+      {
+        *_destroyed = true;
+        _thread.detach();
+        return;
+      }
+      _thread.join();
+    }
+
+    TimerWheel(TimerWheel const &) = delete;
+    TimerWheel &operator=(TimerWheel const &) = delete;
+
+    /** Runs `fn` once, `delay` from now. */
+    Timer after(std::chrono::milliseconds delay, std::function<void()> fn)
+    {
+      return schedule(delay, std::chrono::milliseconds{ 0 }, std::move(fn));
+    }
+
+    /** Runs `fn` every `period` (at least a tick), until cancelled. */
+    Timer every(std::chrono::milliseconds period, std::function<void()> fn)
+    {
+      period = std::max(period, std::chrono::milliseconds{ 1 });
+      return schedule(period, period, std::move(fn));
+    }
+
+    bool cancel(std::uint64_t id)
+    {
+      // destroyed out of the lock, the callback may own the last reference
+      // to objects cancelling timers of their own.
+      std::function<void()> dropped;
+      std::unique_lock<std::mutex> lock(_lock);
+      auto it = _timers.find(id);
+      auto erased = it != _timers.end();
+      if(erased)
+      {
+        dropped = std::move(it->second.fn);
+        _timers.erase(it);
+      }
+      if(std::this_thread::get_id() != _thread.get_id())
+      {
+        _idle.wait(lock, [this, id]() { return _running != id; });
+      }
+      return erased;
+    }
+
+    /** Whether the caller is a callback of this wheel. */
+    bool on_wheel_thread()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      return _thread.joinable() && std::this_thread::get_id() == _thread.get_id();
+    }
+
+    /** Number of scheduled timers. */
+    std::size_t size()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      return _timers.size();
+    }
+
+  private:
+    static constexpr std::uint64_t level0_bits = 8;
+    static constexpr std::uint64_t level_bits = 6;
+    static constexpr std::size_t levels = 4;
+
+    struct Entry
+    {
+      std::uint64_t expires;
+      std::uint64_t period;
+      std::function<void()> fn;
+    };
+
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::condition_variable _idle;
+    std::unordered_map<std::uint64_t, Entry> _timers;
+    std::array<std::vector<std::vector<std::uint64_t>>, levels> _slots{};
+    std::uint64_t _next_id{ 1 };
+    std::uint64_t _now{ 0 };
+    std::uint64_t _running{ 0 };
+    /** Set when a running callback destroyed the wheel, lives on its thread. */
+    bool *_destroyed{ nullptr };
+    clock::time_point _start{};
+    bool _stopping{ false };
+    std::thread _thread;
+
+    static std::uint64_t slots_of(std::size_t level)
+    {
+      return std::uint64_t{ 1 } << (level == 0 ? level0_bits : level_bits);
+    }
+
+    /** The first tick the level's slots cover, as a shift. */
+    static std::uint64_t shift_of(std::size_t level)
+    {
+      return level == 0 ? 0 : level0_bits + (level - 1) * level_bits;
+    }
+
+    std::uint64_t tick_of(clock::time_point t) const
+    {
+      auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t - _start).count();
+      return ms < 0 ? 0 : static_cast<std::uint64_t>(ms);
+    }
+
+    Timer schedule(std::chrono::milliseconds delay,
+                   std::chrono::milliseconds period,
+                   std::function<void()> fn)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      if(!_thread.joinable())
+      {
+        for(std::size_t l = 0; l < levels; l++)
+        {
+          _slots[l].resize(slots_of(l));
+        }
+        _start = clock::now();
+        _thread = std::thread{ &TimerWheel::run, this };
+      }
+      auto now = tick_of(clock::now());
+      if(_timers.empty())
+      {
+        // the idle time is not ticked through.
+        _now = std::max(_now, now);
+      }
+      auto id = _next_id++;
+      // from the current time, the wheel may lag behind by a few ticks.
+      auto expires = std::max(now, _now)
+        + static_cast<std::uint64_t>(std::max<long long>(delay.count(), 1));
+      auto every = static_cast<std::uint64_t>(period.count());
+      _timers.emplace(id, Entry{ expires, every, std::move(fn) });
+      place(id, expires);
+      _wake.notify_all();
+      return Timer{ this, id };
+    }
+
+    void place(std::uint64_t id, std::uint64_t expires)
+    {
+      expires = std::max(expires, _now + 1);
+      for(std::size_t l = 0; l < levels; l++)
+      {
+        auto shift = shift_of(l);
+        if((expires >> shift) - (_now >> shift) < slots_of(l))
+        {
+          _slots[l][(expires >> shift) & (slots_of(l) - 1)].push_back(id);
+          return;
+        }
+      }
+      // beyond the last level, the timer waits in the farthest slot & is
+      // placed again when the slot comes up.
+      auto shift = shift_of(levels - 1);
+      _slots[levels - 1][((_now >> shift) - 1) & (slots_of(levels - 1) - 1)].push_back(id);
+    }
+
+    /** Moves the timers of the upper level slots that came up one level down. */
+    void cascade()
+    {
+      for(std::size_t l = 1; l < levels; l++)
+      {
+        if((_now & ((std::uint64_t{ 1 } << shift_of(l)) - 1)) != 0)
+        {
+          return;
+        }
+        auto &slot = _slots[l][(_now >> shift_of(l)) & (slots_of(l) - 1)];
+        auto ids = std::move(slot);
+        slot.clear();
+        for(auto id : ids)
+        {
+          if(auto it = _timers.find(id); it != _timers.end())
+          {
+            place(id, it->second.expires);
+          }
+        }
+      }
+    }
+
+    void run()
+    {
+      auto destroyed = false;
+      std::unique_lock<std::mutex> lock(_lock);
+      _destroyed = &destroyed;
+      while(!_stopping)
+      {
+        if(_timers.empty())
+        {
+          _wake.wait(lock, [this]() { return _stopping || !_timers.empty(); });
+          continue;
+        }
+        auto target = tick_of(clock::now());
+        if(_now >= target)
+        {
+          _wake.wait_until(lock, _start + std::chrono::milliseconds{ _now + 1 });
+          continue;
+        }
+        while(_now < target && !_stopping)
+        {
+          _now++;
+          cascade();
+          auto &slot = _slots[0][_now & (slots_of(0) - 1)];
+          auto ids = std::move(slot);
+          slot.clear();
+          for(auto id : ids)
+          {
+            auto it = _timers.find(id);
+            if(it == _timers.end())
+            {
+              continue;
+            }
+            if(it->second.expires > _now)
+            {
+              place(id, it->second.expires);
+              continue;
+            }
+            std::function<void()> fn;
+            if(it->second.period > 0)
+            {
+              fn = it->second.fn;
+              it->second.expires = _now + it->second.period;
+              place(id, it->second.expires);
+            }
+            else
+            {
+              fn = std::move(it->second.fn);
+              _timers.erase(it);
+            }
+            _running = id;
+            lock.unlock();
+            try
+            {
+              fn();
+            }
+            catch(std::exception const &e)
+            {
+              std::cerr << "timer callback failed: " << e.what() << "\n";
+            }
+            catch(...)
+            {
+              std::cerr << "timer callback failed\n";
+            }
+            fn = nullptr;
+            if(destroyed)
+            {
+              // the wheel is gone, nothing of it may be touched.
+              return;
+            }
+            lock.lock();
+            _running = 0;
+            _idle.notify_all();
+          }
+        }
+      }
+    }
+  };
+
+  /** A bounded pool of threads running the ready strands (see `Strand`).
+   * Threads are started as strands get ready, up to `max_threads`, & then
+   * stay: a thousand paced streams cost timers & runs, not threads.
+   */
+  class StrandPool
+  {
+  public:
+    explicit StrandPool(std::size_t max_threads = std::max(2u, std::thread::hardware_concurrency()))
+      : _max_threads{ std::max<std::size_t>(max_threads, 1) }
+    {
+    }
+
+    /** The ready runs are dropped, the running ones are waited for. From
+     * one of its runs, that run's thread is detached & returns after it.
+     */
+    ~StrandPool()
+    {
+      std::deque<std::function<void()>> dropped;
+      {
+        std::lock_guard<std::mutex> lock(_lock);
+        _stopping = true;
+        dropped.swap(_ready);
+        _wake.notify_all();
+      }
+      if(_current == this)
+      {
+        *_destroyed = true;
+      }
+      for(auto &t : _threads)
+      {
+        if(t.get_id() == std::this_thread::get_id())
+        {
+          t.detach();
+        }
+        else
+        {
+          t.join();
+        }
+      }
+    }
+
+    StrandPool(StrandPool const &) = delete;
+    StrandPool &operator=(StrandPool const &) = delete;
+
+    /** Queues a strand's run, for the next free thread. */
+    void schedule(std::function<void()> run)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      if(_stopping)
+      {
+        return;
+      }
+      _ready.push_back(std::move(run));
+      if(_idle == 0 && _threads.size() < _max_threads)
+      {
+        _threads.emplace_back(&StrandPool::work, this);
+      }
+      else
+      {
+        _wake.notify_one();
+      }
+    }
+
+  private:
+    std::size_t const _max_threads;
+    std::mutex _lock;
+    std::condition_variable _wake;
+    std::deque<std::function<void()>> _ready;
+    std::vector<std::thread> _threads;
+    std::size_t _idle{ 0 };
+    bool _stopping{ false };
+
+    /** The pool of the calling thread, & the flag its destruction sets. */
+    static inline thread_local StrandPool *_current{ nullptr };
+    static inline thread_local bool *_destroyed{ nullptr };
+
+    void work()
+    {
+      auto destroyed = false;
+      _current = this;
+      _destroyed = &destroyed;
+      std::unique_lock<std::mutex> lock(_lock);
+      while(true)
+      {
+        _idle++;
+        _wake.wait(lock, [this]() { return _stopping || !_ready.empty(); });
+        _idle--;
+        if(_stopping)
+        {
+          return;
+        }
+        auto run = std::move(_ready.front());
+        _ready.pop_front();
+        lock.unlock();
+        run();
+        run = nullptr;
+        if(destroyed)
+        {
+          // the pool is gone, nothing of it may be touched.
+          return;
+        }
+        lock.lock();
+      }
+    }
+  };
+
+  /** Runs the posted tasks in order, one at a time, on the threads of a
+   * `StrandPool`. A strand waiting for tasks holds no thread.
+   */
+  class Strand
+  {
+  public:
+    explicit Strand(StrandPool &pool)
+      : _s{ std::make_shared<state>(pool) }
+    {
+    }
+
+    /** The queued tasks are dropped, a running one finishes on its own. */
+    ~Strand()
+    {
+      std::deque<std::function<void()>> dropped;
+      std::lock_guard<std::mutex> lock(_s->lock);
+      _s->closed = true;
+      dropped.swap(_s->tasks);
+    }
+
+    Strand(Strand const &) = delete;
+    Strand &operator=(Strand const &) = delete;
+
+    void post(std::function<void()> fn)
+    {
+      std::lock_guard<std::mutex> lock(_s->lock);
+      if(_s->closed)
+      {
+        return;
+      }
+      _s->tasks.push_back(std::move(fn));
+      if(!_s->scheduled)
+      {
+        _s->scheduled = true;
+        _s->pool.schedule([s = _s]() { run(s); });
+      }
+    }
+
+    /** Drops the queued tasks & waits for the running one, unless called
+     * from it. Later posts are dropped.
+     */
+    void close()
+    {
+      std::deque<std::function<void()>> dropped;
+      std::unique_lock<std::mutex> lock(_s->lock);
+      _s->closed = true;
+      dropped.swap(_s->tasks);
+      if(_s->thread != std::this_thread::get_id())
+      {
+        _s->idle.wait(lock, [this]() { return _s->thread == std::thread::id{}; });
+      }
+    }
+
+  private:
+    /** Tasks run before the strand gives its thread to the next ready one. */
+    static constexpr int batch = 16;
+
+    /** Shared with the pool's queue, which may hold it after the strand. */
+    struct state
+    {
+      explicit state(StrandPool &pool)
+        : pool{ pool }
+      {
+      }
+
+      StrandPool &pool;
+      std::mutex lock;
+      std::condition_variable idle;
+      std::deque<std::function<void()>> tasks;
+      std::thread::id thread{};
+      bool scheduled{ false };
+      bool closed{ false };
+    };
+
+    static void run(std::shared_ptr<state> s)
+    {
+      std::unique_lock<std::mutex> lock(s->lock);
+      s->thread = std::this_thread::get_id();
+      for(auto n = 0; n < batch && !s->tasks.empty(); n++)
+      {
+        auto fn = std::move(s->tasks.front());
+        s->tasks.pop_front();
+        lock.unlock();
+        try
+        {
+          fn();
+        }
+        catch(std::exception const &e)
+        {
+          std::cerr << "strand task failed: " << e.what() << "\n";
+        }
+        catch(...)
+        {
+          std::cerr << "strand task failed\n";
+        }
+        fn = nullptr;
+        lock.lock();
+      }
+      s->thread = std::thread::id{};
+      s->idle.notify_all();
+      // a closed strand's pool may be gone (its owner was, from a task).
+      s->scheduled = !s->tasks.empty() && !s->closed;
+      if(s->scheduled)
+      {
+        s->pool.schedule([s]() { run(s); });
+      }
+    }
+
+    std::shared_ptr<state> _s;
+  };
+
+  inline bool Timer::cancel()
+  {
+    return _wheel != nullptr && _wheel->cancel(_id);
+  }
+}
+
+#endif // POD_TIMER_H_
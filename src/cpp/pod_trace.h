@@ -0,0 +1,429 @@
+#ifndef POD_TRACE_H_
+#define POD_TRACE_H_
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Tracing of the invoke lifecycle, in Chrome trace format (also loadable by
+// Perfetto).
+//
+// Spans are recorded into per thread ring buffers, keyed by the invoke id.
+// When tracing is off, a span costs one relaxed atomic load.
+
+namespace lotuc::pod::trace
+{
+  struct Event
+  {
+    char const *name;
+    char id[40];
+    long long ts_us;
+    long long dur_us;
+    unsigned long long tid;
+
+    /** The resource usage of a finished invoke (see `pod_usage.h`), -1 for
+     * the other spans.
+     */
+    long long cpu_us{ -1 };
+    long long bytes_in{ 0 };
+    long long bytes_out{ 0 };
+    long long allocations{ 0 };
+  };
+
+  inline long long now_us()
+  {
+    auto d = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  }
+
+  /** A thread's ring buffer, only written by its thread, without locking:
+   * an event is published by bumping `_head`. Readers copy the events, then
+   * drop the ones the writer may have overwritten meanwhile.
+   */
+  class Ring
+  {
+  public:
+    static constexpr std::size_t capacity = 8192;
+
+    void record(Event const &e)
+    {
+      auto head = _head.load(std::memory_order_relaxed);
+      _events[head % capacity] = e;
+      _head.store(head + 1, std::memory_order_release);
+    }
+
+    void collect(std::vector<Event> &out)
+    {
+      auto head = _head.load(std::memory_order_acquire);
+      auto from = std::max(_base.load(std::memory_order_relaxed), head - std::min(head, capacity));
+      auto start = out.size();
+      for(auto i = from; i < head; i++)
+      {
+        out.push_back(_events[i % capacity]);
+      }
+      // the writer is at most at `now`, the slots of the events before
+      // `now - capacity` (& the one it may be writing) are reused.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      auto now = _head.load(std::memory_order_relaxed);
+      auto overwritten = now >= capacity ? now - capacity + 1 : 0;
+      if(overwritten > from)
+      {
+        auto n = std::min(overwritten - from, out.size() - start);
+        out.erase(out.begin() + static_cast<std::ptrdiff_t>(start),
+                  out.begin() + static_cast<std::ptrdiff_t>(start + n));
+      }
+    }
+
+    /** Hides the recorded events, the writer is not disturbed. */
+    void clear()
+    {
+      _base.store(_head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<std::size_t> _head{};
+    std::atomic<std::size_t> _base{};
+    std::array<Event, capacity> _events;
+  };
+
+  class Tracer
+  {
+  public:
+    std::atomic_bool enabled{ false };
+
+    /** At most this many rings (about 1 MB each) are allocated, the threads
+     * past it record nothing (see `dropped`) until a ring is released.
+     */
+    std::size_t max_rings{ 64 };
+
+    /** Rings of exited threads kept for reuse (their events stay until
+     * overwritten), the ones past it are freed with their events.
+     */
+    std::size_t max_released{ 8 };
+
+    static Tracer &instance()
+    {
+      static Tracer t;
+      return t;
+    }
+
+    /** The calling thread's ring, `nullptr` while all `max_rings` are
+     * taken. Rings of exited threads are reused.
+     */
+    Ring *ring()
+    {
+      thread_local held h{ *this };
+      if(h.ring == nullptr && !_full.load(std::memory_order_relaxed))
+      {
+        h.ring = acquire();
+      }
+      return h.ring;
+    }
+
+    /** Records `e` on the calling thread's ring, or counts it dropped. */
+    void record(Event const &e)
+    {
+      if(auto r = ring(); r != nullptr)
+      {
+        r->record(e);
+      }
+      else
+      {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    /** Events not recorded since all the rings were taken. */
+    std::size_t dropped() const
+    {
+      return _dropped.load(std::memory_order_relaxed);
+    }
+
+    void start()
+    {
+      enabled.store(true);
+    }
+
+    void stop()
+    {
+      enabled.store(false);
+    }
+
+    void clear()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      for(auto &r : _rings)
+      {
+        r->clear();
+      }
+    }
+
+    /** Chrome trace JSON of the recorded events. */
+    std::string dump()
+    {
+      std::vector<Event> events;
+      {
+        std::lock_guard<std::mutex> lock(_lock);
+        for(auto &r : _rings)
+        {
+          r->collect(events);
+        }
+      }
+      std::sort(events.begin(), events.end(), [](auto &a, auto &b) { return a.ts_us < b.ts_us; });
+
+      std::ostringstream o;
+      o << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+      auto first = true;
+      for(auto &e : events)
+      {
+        o << (first ? "" : ",") << "{\"name\":\"" << e.name << "\",\"cat\":\"pod\",\"ph\":\"X\""
+          << ",\"pid\":1,\"tid\":" << e.tid << ",\"ts\":" << e.ts_us << ",\"dur\":" << e.dur_us
+          << ",\"args\":{\"id\":\"";
+        for(auto c = e.id; *c != '\0'; c++)
+        {
+          if(*c == '"' || *c == '\\')
+          {
+            o << '\\';
+          }
+          o << *c;
+        }
+        o << "\"";
+        if(e.cpu_us >= 0)
+        {
+          o << ",\"cpu-us\":" << e.cpu_us << ",\"bytes-in\":" << e.bytes_in
+            << ",\"bytes-out\":" << e.bytes_out << ",\"allocations\":" << e.allocations;
+        }
+        o << "}}";
+        first = false;
+      }
+      o << "],\"otherData\":{\"dropped\":" << dropped() << "}}";
+      return o.str();
+    }
+
+    void dump_to(std::string const &path)
+    {
+      std::ofstream out(path, std::ios::trunc);
+      out << dump();
+    }
+
+  private:
+    std::mutex _lock;
+    std::vector<std::unique_ptr<Ring>> _rings;
+    std::vector<Ring *> _released;
+    /** No ring to acquire, spares the lock to the threads without one. */
+    std::atomic_bool _full{ false };
+    std::atomic<std::size_t> _dropped{ 0 };
+
+    struct held
+    {
+      Tracer &tracer;
+      Ring *ring{ nullptr };
+
+      held(Tracer &t)
+        : tracer{ t }
+      {
+      }
+
+      ~held()
+      {
+        if(ring != nullptr)
+        {
+          tracer.release(ring);
+        }
+      }
+    };
+
+    Ring *acquire()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      if(!_released.empty())
+      {
+        auto r = _released.back();
+        _released.pop_back();
+        return r;
+      }
+      if(_rings.size() >= max_rings)
+      {
+        _full.store(true, std::memory_order_relaxed);
+        return nullptr;
+      }
+      return _rings.emplace_back(std::make_unique<Ring>()).get();
+    }
+
+    void release(Ring *r)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      _full.store(false, std::memory_order_relaxed);
+      if(_released.size() < max_released)
+      {
+        _released.push_back(r);
+        return;
+      }
+      // `dump` collects under the lock, the ring can go.
+      std::erase_if(_rings, [r](auto &p) { return p.get() == r; });
+    }
+  };
+
+  /** A small number per thread, unique for the process' life. */
+  inline unsigned long long tid()
+  {
+    static std::atomic<unsigned long long> next{ 1 };
+    thread_local auto const id = next.fetch_add(1, std::memory_order_relaxed);
+    return id;
+  }
+
+  /** Records the enclosing scope as a span named `name` (a string literal). */
+  class Span
+  {
+  public:
+    Span(char const *name)
+      : Span{ name, std::string_view{} }
+    {
+    }
+
+    Span(char const *name, std::string_view id)
+      : _name{ name }
+      , _start{ Tracer::instance().enabled.load(std::memory_order_relaxed) ? now_us() : -1 }
+    {
+      if(_start >= 0)
+      {
+        set_id(id);
+      }
+    }
+
+    Span(Span const &) = delete;
+    Span &operator=(Span const &) = delete;
+
+    /** The id may only be known in the middle of the span (e.g. `read`). */
+    void set_id(std::string_view id)
+    {
+      if(_start < 0)
+      {
+        return;
+      }
+      auto n = std::min(id.size(), sizeof(_id) - 1);
+      std::memcpy(_id, id.data(), n);
+      _id[n] = '\0';
+    }
+
+    ~Span()
+    {
+      if(_start < 0)
+      {
+        return;
+      }
+      Event e{ _name, {}, _start, now_us() - _start, tid() };
+      std::memcpy(e.id, _id, sizeof(_id));
+      Tracer::instance().record(e);
+    }
+
+  private:
+    char const *_name;
+    long long _start;
+    char _id[40]{};
+  };
+
+  /** Records a finished invoke, from `start_us` to now, with its resource
+   * usage.
+   */
+  inline void complete(std::string_view id,
+                       long long start_us,
+                       long long cpu_us,
+                       long long bytes_in,
+                       long long bytes_out,
+                       long long allocations)
+  {
+    if(!Tracer::instance().enabled.load(std::memory_order_relaxed))
+    {
+      return;
+    }
+    Event e{ "invoke", {}, start_us, now_us() - start_us, tid() };
+    auto n = std::min(id.size(), sizeof(e.id) - 1);
+    std::memcpy(e.id, id.data(), n);
+    e.id[n] = '\0';
+    e.cpu_us = cpu_us;
+    e.bytes_in = bytes_in;
+    e.bytes_out = bytes_out;
+    e.allocations = allocations;
+    Tracer::instance().record(e);
+  }
+
+  namespace detail
+  {
+    /** The self-pipe waking the dump thread, written by the handler. */
+    inline int dump_pipe[2]{ -1, -1 };
+
+    /** Where the dump thread (started once) writes. */
+    inline std::mutex dump_lock;
+    inline std::string dump_path;
+
+    inline void on_dump_signal(int)
+    {
+      auto saved = errno;
+      char c{};
+      [[maybe_unused]] auto n = ::write(dump_pipe[1], &c, 1);
+      errno = saved;
+    }
+  }
+
+  /** Dumps the trace to `path` whenever the process receives `signum` (e.g.
+   * SIGUSR2). The dump happens on a background thread, woken through a
+   * self-pipe, not in the handler. A later call changes the path, the thread
+   * is shared.
+   */
+  inline void dump_on_signal(int signum, std::string const &path)
+  {
+    std::lock_guard<std::mutex> lock(detail::dump_lock);
+    detail::dump_path = path;
+    if(detail::dump_pipe[0] < 0)
+    {
+      if(::pipe2(detail::dump_pipe, O_CLOEXEC) != 0)
+      {
+        throw std::runtime_error{ std::string{ "trace: pipe: " } + std::strerror(errno) };
+      }
+      // a full pipe already has a dump pending.
+      ::fcntl(detail::dump_pipe[1], F_SETFL, O_NONBLOCK);
+      std::thread([fd = detail::dump_pipe[0]]() {
+        char buf[64];
+        while(true)
+        {
+          auto n = ::read(fd, buf, sizeof(buf));
+          if(n < 0 && errno == EINTR)
+          {
+            continue;
+          }
+          if(n <= 0)
+          {
+            return;
+          }
+          std::string path;
+          {
+            std::lock_guard<std::mutex> lock(detail::dump_lock);
+            path = detail::dump_path;
+          }
+          Tracer::instance().dump_to(path);
+        }
+      }).detach();
+    }
+    std::signal(signum, detail::on_dump_signal);
+  }
+}
+
+#endif // POD_TRACE_H_
@@ -0,0 +1,223 @@
+#ifndef POD_USAGE_H_
+#define POD_USAGE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Per invoke resource accounting, for capacity planning.
+//
+// An invoke is measured on its thread, around the var's `deref`: thread CPU
+// time, the bytes of its args (streamed ones as they are read) & of the output
+// written from that thread, and the heap allocations when the allocation hook
+// is compiled in. Work the var hands to threads of its own is not attributed.
+// The totals are kept per var & per caller tag (the `tag` invoke option).
+//
+// The allocation hook replaces the global `operator new`/`delete`, define
+// `LOTUC_POD_ALLOCATION_HOOK` in exactly one translation unit before including
+// the pod headers.
+
+namespace lotuc::pod::usage
+{
+  struct Usage
+  {
+    long long count{ 0 };
+    long long cpu_ns{ 0 };
+    long long bytes_in{ 0 };
+    long long bytes_out{ 0 };
+    long long allocations{ 0 };
+    long long allocated_bytes{ 0 };
+
+    Usage &operator+=(Usage const &u)
+    {
+      count += u.count;
+      cpu_ns += u.cpu_ns;
+      bytes_in += u.bytes_in;
+      bytes_out += u.bytes_out;
+      allocations += u.allocations;
+      allocated_bytes += u.allocated_bytes;
+      return *this;
+    }
+  };
+
+  /** Set by the allocation hook, when it's compiled in. */
+  inline std::atomic_bool allocations_counted{ false };
+
+  inline thread_local std::uint64_t thread_allocations{ 0 };
+  inline thread_local std::uint64_t thread_allocated_bytes{ 0 };
+
+  /** The invoke measured on this thread, if any. */
+  inline thread_local Usage *current{ nullptr };
+
+  /** Accounts output bytes to the invoke running on this thread. */
+  inline void add_out(std::size_t n)
+  {
+    if(current != nullptr)
+    {
+      current->bytes_out += static_cast<long long>(n);
+    }
+  }
+
+  /** Accounts streamed input bytes to the invoke running on this thread. */
+  inline void add_in(std::size_t n)
+  {
+    if(current != nullptr)
+    {
+      current->bytes_in += static_cast<long long>(n);
+    }
+  }
+
+  inline long long thread_cpu_ns()
+  {
+    timespec ts{};
+    if(::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    {
+      return 0;
+    }
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+  /** Measures the enclosing scope into `u`. */
+  class Meter
+  {
+  public:
+    explicit Meter(Usage &u)
+      : _usage{ u }
+      , _prev{ current }
+      , _cpu_ns{ thread_cpu_ns() }
+      , _allocations{ thread_allocations }
+      , _allocated_bytes{ thread_allocated_bytes }
+    {
+      current = &u;
+    }
+
+    ~Meter()
+    {
+      current = _prev;
+      _usage.count = 1;
+      _usage.cpu_ns += thread_cpu_ns() - _cpu_ns;
+      _usage.allocations += static_cast<long long>(thread_allocations - _allocations);
+      _usage.allocated_bytes += static_cast<long long>(thread_allocated_bytes - _allocated_bytes);
+    }
+
+    Meter(Meter const &) = delete;
+    Meter &operator=(Meter const &) = delete;
+
+  private:
+    Usage &_usage;
+    Usage *_prev;
+    long long _cpu_ns;
+    std::uint64_t _allocations;
+    std::uint64_t _allocated_bytes;
+  };
+
+  /** Totals per var & per caller tag. */
+  class Ledger
+  {
+  public:
+    void add(std::string const &var, std::string const &tag, Usage const &u)
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      _vars[var] += u;
+      if(!tag.empty())
+      {
+        _tags[tag] += u;
+      }
+    }
+
+    /** `{var {metric n}}`, the tags' totals under `tag:<tag>`. */
+    std::map<std::string, std::map<std::string, long long>> totals()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      std::map<std::string, std::map<std::string, long long>> ret;
+      for(auto &[var, u] : _vars)
+      {
+        ret[var] = metrics(u);
+      }
+      for(auto &[tag, u] : _tags)
+      {
+        ret["tag:" + tag] = metrics(u);
+      }
+      return ret;
+    }
+
+    void reset()
+    {
+      std::lock_guard<std::mutex> lock(_lock);
+      _vars.clear();
+      _tags.clear();
+    }
+
+    static std::map<std::string, long long> metrics(Usage const &u)
+    {
+      std::map<std::string, long long> m{ { "count", u.count },
+                                          { "cpu-us", u.cpu_ns / 1000 },
+                                          { "bytes-in", u.bytes_in },
+                                          { "bytes-out", u.bytes_out } };
+      if(allocations_counted.load(std::memory_order_relaxed))
+      {
+        m["allocations"] = u.allocations;
+        m["allocated-bytes"] = u.allocated_bytes;
+      }
+      return m;
+    }
+
+  private:
+    std::mutex _lock;
+    std::map<std::string, Usage> _vars;
+    std::map<std::string, Usage> _tags;
+  };
+}
+
+#ifdef LOTUC_POD_ALLOCATION_HOOK
+#include <cstdlib>
+#include <new>
+
+namespace lotuc::pod::usage::detail
+{
+  [[maybe_unused]] static bool const hook_installed = (allocations_counted.store(true), true);
+}
+
+// not inlined: the compiler would see `free` on a `new` pointer at the call
+// sites.
+[[gnu::noinline]] void *operator new(std::size_t n)
+{
+  lotuc::pod::usage::thread_allocations++;
+  lotuc::pod::usage::thread_allocated_bytes += n;
+  if(auto p = std::malloc(n == 0 ? 1 : n))
+  {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+[[gnu::noinline]] void *operator new[](std::size_t n)
+{
+  return ::operator new(n);
+}
+
+[[gnu::noinline]] void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete[](void *p) noexcept
+{
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+[[gnu::noinline]] void operator delete[](void *p, std::size_t) noexcept
+{
+  std::free(p);
+}
+#endif
+
+#endif // POD_USAGE_H_